@@ -3,6 +3,8 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/tsc.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 
 /* A block device. */
@@ -17,8 +19,8 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    struct block_stats stats;           /* Statistics. */
+    uint64_t busy_start;                /* TSC when queue became nonempty. */
   };
 
 /* List of all block devices. */
@@ -27,7 +29,18 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 /* The block block assigned to each Pintos role. */
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
+/* Kinds of requests, for statistics. */
+enum request_type
+  {
+    REQUEST_READ,
+    REQUEST_WRITE,
+    REQUEST_FLUSH
+  };
+
 static struct block *list_elem_to_block (struct list_elem *);
+static uint64_t request_begin (struct block *);
+static void request_end (struct block *, uint64_t start,
+                         enum request_type, size_t sector_cnt);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -113,6 +126,19 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Verifies that CNT sectors starting at SECTOR all lie within
+   BLOCK, panicking if not.  Compares against the room left after
+   SECTOR so that a huge CNT cannot wrap around. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
+{
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", count=%zu, "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt,
+           block->size);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,23 +146,111 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
+  uint64_t start;
+
   check_sector (block, sector);
+  start = request_begin (block);
   block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  request_end (block, start, REQUEST_READ, 1);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
    BLOCK_SECTOR_SIZE bytes.  Returns after the block device has
-   acknowledged receiving the data.
+   acknowledged receiving the data.  The data may still be in the
+   device's volatile write cache; call block_flush() to make sure
+   that it reaches nonvolatile storage.
    Internally synchronizes accesses to block devices, so external
    per-block device locking is unneeded. */
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
+  uint64_t start;
+
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
+  start = request_begin (block);
   block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  request_end (block, start, REQUEST_WRITE, 1);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Drivers that support it transfer all of the sectors
+   in a single request.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     void *buffer_, size_t cnt)
+{
+  uint8_t *buffer = buffer_;
+  uint64_t start;
+
+  if (cnt == 0)
+    return;
+  check_sectors (block, sector, cnt);
+  if (block->ops->read_multiple == NULL)
+    {
+      for (; cnt > 0; cnt--, sector++, buffer += BLOCK_SECTOR_SIZE)
+        block_read (block, sector, buffer);
+      return;
+    }
+
+  start = request_begin (block);
+  block->ops->read_multiple (block->aux, sector, buffer, cnt);
+  request_end (block, start, REQUEST_READ, cnt);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Drivers that support it transfer all of the sectors in a
+   single request.  Returns after the block device has
+   acknowledged receiving the data, which may still be in its
+   write cache, as for block_write().
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      const void *buffer_, size_t cnt)
+{
+  const uint8_t *buffer = buffer_;
+  uint64_t start;
+
+  if (cnt == 0)
+    return;
+  check_sectors (block, sector, cnt);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  if (block->ops->write_multiple == NULL)
+    {
+      for (; cnt > 0; cnt--, sector++, buffer += BLOCK_SECTOR_SIZE)
+        block_write (block, sector, buffer);
+      return;
+    }
+
+  start = request_begin (block);
+  block->ops->write_multiple (block->aux, sector, buffer, cnt);
+  request_end (block, start, REQUEST_WRITE, cnt);
+}
+
+/* Waits until all data written to BLOCK so far has reached
+   nonvolatile storage, by flushing the device's write cache.
+   Writes are only guaranteed to survive a power failure, and
+   to reach the disk in order relative to writes issued after
+   the flush, once this function returns.  Flushing is
+   expensive, so callers should flush only at points where they
+   need durability, such as when a file system operation
+   commits. */
+void
+block_flush (struct block *block)
+{
+  uint64_t start;
+
+  if (block->ops->flush == NULL)
+    return;
+
+  start = request_begin (block);
+  block->ops->flush (block->aux);
+  request_end (block, start, REQUEST_FLUSH, 0);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,21 +274,79 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Stores a snapshot of BLOCK's statistics into *STATS.
+   If requests are in progress, the busy time includes the time
+   spent on them so far. */
+void
+block_get_stats (struct block *block, struct block_stats *stats)
+{
+  enum intr_level old_level = intr_disable ();
+  *stats = block->stats;
+  if (stats->queue_depth > 0)
+    stats->busy_cycles += tsc_read () - block->busy_start;
+  intr_set_level (old_level);
+}
+
+/* Prints the nonempty buckets of latency histogram HIST, which
+   is labeled NAME. */
+static void
+print_histogram (const char *name, const uint64_t hist[BLOCK_HIST_BUCKETS])
+{
+  int i;
+
+  printf ("  %s latency (cycles):", name);
+  for (i = 0; i < BLOCK_HIST_BUCKETS; i++)
+    if (hist[i] != 0)
+      printf (" %s2^%d: %"PRIu64,
+              i == BLOCK_HIST_BUCKETS - 1 ? ">=" : "", i, hist[i]);
+  printf ("\n");
+}
+
+/* Prints statistics for BLOCK. */
+void
+block_print_device_stats (struct block *block)
+{
+  struct block_stats s;
+
+  block_get_stats (block, &s);
+  printf ("%s (%s): %llu reads, %llu writes, %llu flushes\n",
+          block->name, block_type_name (block->type),
+          s.read_cnt, s.write_cnt, s.flush_cnt);
+  printf ("  %llu bytes read, %llu bytes written, "
+          "%"PRIu64" busy cycles, queue depth %u (max %u)\n",
+          s.read_bytes, s.write_bytes, s.busy_cycles,
+          s.queue_depth, s.max_queue_depth);
+  if (s.read_cnt > 0)
+    print_histogram ("read", s.read_hist);
+  if (s.write_cnt > 0)
+    print_histogram ("write", s.write_hist);
+  if (s.flush_cnt > 0)
+    print_histogram ("flush", s.flush_hist);
+}
+
+/* Prints statistics for each block device used for a Pintos
+   role, by role, followed by those for the remaining block
+   devices in probe order. */
 void
 block_print_stats (void)
 {
+  struct block *block;
   int i;
 
-  for (i = 0; i < BLOCK_CNT; i++)
+  for (i = 0; i < BLOCK_ROLE_CNT; i++)
+    if (block_by_role[i] != NULL)
+      {
+        printf ("%s: ", block_type_name (i));
+        block_print_device_stats (block_by_role[i]);
+      }
+
+  for (block = block_first (); block != NULL; block = block_next (block))
     {
-      struct block *block = block_by_role[i];
-      if (block != NULL)
-        {
-          printf ("%s (%s): %llu reads, %llu writes\n",
-                  block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
-        }
+      for (i = 0; i < BLOCK_ROLE_CNT; i++)
+        if (block_by_role[i] == block)
+          break;
+      if (i == BLOCK_ROLE_CNT)
+        block_print_device_stats (block);
     }
 }
 
@@ -198,8 +370,8 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  memset (&block->stats, 0, sizeof block->stats);
+  block->busy_start = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -221,3 +393,75 @@ list_elem_to_block (struct list_elem *list_elem)
           : NULL);
 }
 
+
+/* Returns the latency histogram bucket for a request that took
+   CYCLES TSC cycles. */
+static int
+latency_bucket (uint64_t cycles)
+{
+  int bucket = 0;
+
+  while (cycles > 1 && bucket < BLOCK_HIST_BUCKETS - 1)
+    {
+      cycles >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Notes that a request to BLOCK is starting.  Returns the TSC
+   value at its start, to be passed to request_end(). */
+static uint64_t
+request_begin (struct block *block)
+{
+  struct block_stats *s = &block->stats;
+  enum intr_level old_level = intr_disable ();
+  uint64_t now = tsc_read ();
+
+  if (s->queue_depth++ == 0)
+    block->busy_start = now;
+  if (s->queue_depth > s->max_queue_depth)
+    s->max_queue_depth = s->queue_depth;
+
+  intr_set_level (old_level);
+  return now;
+}
+
+/* Notes that a request of the given TYPE to BLOCK that started
+   at TSC value START and transferred SECTOR_CNT sectors is
+   complete. */
+static void
+request_end (struct block *block, uint64_t start, enum request_type type,
+             size_t sector_cnt)
+{
+  struct block_stats *s = &block->stats;
+  enum intr_level old_level = intr_disable ();
+  uint64_t now = tsc_read ();
+  int bucket = latency_bucket (now - start);
+
+  ASSERT (s->queue_depth > 0);
+  if (--s->queue_depth == 0)
+    s->busy_cycles += now - block->busy_start;
+
+  switch (type)
+    {
+    case REQUEST_READ:
+      s->read_cnt += sector_cnt;
+      s->read_bytes += sector_cnt * BLOCK_SECTOR_SIZE;
+      s->read_hist[bucket]++;
+      break;
+
+    case REQUEST_WRITE:
+      s->write_cnt += sector_cnt;
+      s->write_bytes += sector_cnt * BLOCK_SECTOR_SIZE;
+      s->write_hist[bucket]++;
+      break;
+
+    case REQUEST_FLUSH:
+      s->flush_cnt++;
+      s->flush_hist[bucket]++;
+      break;
+    }
+
+  intr_set_level (old_level);
+}
@@ -53,10 +53,41 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, void *,
+                          size_t cnt);
+void block_write_multiple (struct block *, block_sector_t, const void *,
+                           size_t cnt);
+void block_flush (struct block *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
 /* Statistics. */
+
+/* Number of buckets in a block device latency histogram.
+   Bucket 0 counts requests that completed in less than 2 TSC
+   cycles, bucket I (for I > 0) those that took between 2**I and
+   2**(I+1) - 1 cycles.  The last bucket also counts every
+   request slower than that. */
+#define BLOCK_HIST_BUCKETS 40
+
+/* Statistics kept for each block device. */
+struct block_stats
+  {
+    unsigned long long read_cnt;        /* Number of sectors read. */
+    unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long read_bytes;      /* Number of bytes read. */
+    unsigned long long write_bytes;     /* Number of bytes written. */
+    unsigned long long flush_cnt;       /* Number of cache flushes. */
+    unsigned queue_depth;               /* Requests now in progress. */
+    unsigned max_queue_depth;           /* Most requests ever in progress. */
+    uint64_t busy_cycles;               /* TSC cycles with requests pending. */
+    uint64_t read_hist[BLOCK_HIST_BUCKETS];  /* Read latencies. */
+    uint64_t write_hist[BLOCK_HIST_BUCKETS]; /* Write latencies. */
+    uint64_t flush_hist[BLOCK_HIST_BUCKETS]; /* Flush latencies. */
+  };
+
+void block_get_stats (struct block *, struct block_stats *);
+void block_print_device_stats (struct block *);
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
@@ -65,6 +96,19 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors in a single
+       request.  If null, the block layer uses one read or write
+       call per sector instead. */
+    void (*read_multiple) (void *aux, block_sector_t, void *buffer,
+                           size_t cnt);
+    void (*write_multiple) (void *aux, block_sector_t, const void *buffer,
+                            size_t cnt);
+
+    /* Optional.  Returns after all data written so far has
+       reached nonvolatile storage.  Null for devices without a
+       volatile write cache. */
+    void (*flush) (void *aux);
   };
 
 struct block *block_register (const char *name, enum block_type,
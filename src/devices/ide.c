@@ -11,11 +11,13 @@
 #include "threads/synch.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3], plus the 48-bit
+   LBA feature set from [ATA-6] for disks over 128 GB. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
-#define reg_error(CHANNEL) ((CHANNEL)->reg_base + 1)    /* Error. */
+#define reg_error(CHANNEL) ((CHANNEL)->reg_base + 1)    /* Error (r/o). */
+#define reg_features(CHANNEL) reg_error (CHANNEL)       /* Features (w/o). */
 #define reg_nsect(CHANNEL) ((CHANNEL)->reg_base + 2)    /* Sector Count. */
 #define reg_lbal(CHANNEL) ((CHANNEL)->reg_base + 3)     /* LBA 0:7. */
 #define reg_lbam(CHANNEL) ((CHANNEL)->reg_base + 4)     /* LBA 15:8. */
@@ -34,6 +36,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +52,26 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_SECTOR_EXT 0x24        /* READ SECTOR EXT. */
+#define CMD_WRITE_SECTOR_EXT 0x34       /* WRITE SECTOR EXT. */
+#define CMD_SET_FEATURES 0xef           /* SET FEATURES. */
+#define CMD_FLUSH_CACHE 0xe7            /* FLUSH CACHE. */
+#define CMD_FLUSH_CACHE_EXT 0xea        /* FLUSH CACHE EXT. */
+
+/* SET FEATURES subcommands, written to the Features register. */
+#define FEAT_ENABLE_WCACHE 0x02         /* Enable write cache. */
+
+/* IDENTIFY DEVICE words. */
+#define ID_CAPACITY 60                  /* 28-bit capacity, 2 words. */
+#define ID_FEATURES 82                  /* Features supported. */
+#define ID_FEATURES_WCACHE 0x0020       /* Write cache. */
+#define ID_COMMAND_SET 83               /* Command sets supported. */
+#define ID_COMMAND_SET_LBA48 0x0400     /* 48-bit Address feature set. */
+#define ID_CAPACITY_LBA48 100           /* 48-bit capacity, 4 words. */
+
+/* If true, disks over 1 GB are registered rather than ignored.
+   Controlled by kernel command-line option "-bigdisks". */
+bool ide_big_disks;
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +80,8 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool lba48;                 /* Use 48-bit LBA commands? */
+    bool write_cache;           /* Is the write cache enabled? */
   };
 
 /* An ATA channel (aka controller).
@@ -84,6 +109,7 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void enable_write_cache (struct ata_disk *);
 
 static void select_sector (struct ata_disk *, block_sector_t);
 static void issue_pio_command (struct channel *, uint8_t command);
@@ -136,6 +162,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->lba48 = false;
+          d->write_cache = false;
         }
 
       /* Register interrupt handler. */
@@ -261,7 +289,8 @@ identify_ata_device (struct ata_disk *d)
 {
   struct channel *c = d->channel;
   char id[BLOCK_SECTOR_SIZE];
-  block_sector_t capacity;
+  uint64_t capacity;
+  uint16_t command_set, features;
   char *model, *serial;
   char extra_info[128];
   struct block *block;
@@ -281,9 +310,24 @@ identify_ata_device (struct ata_disk *d)
     }
   input_sector (c, id);
 
-  /* Calculate capacity.
+  /* Calculate capacity, using the 48-bit count if the disk
+     supports 48-bit addressing.  block_sector_t limits us to the
+     first 2 TB of larger disks.
      Read model name and serial number. */
-  capacity = *(uint32_t *) &id[60 * 2];
+  capacity = *(uint32_t *) &id[ID_CAPACITY * 2];
+  command_set = *(uint16_t *) &id[ID_COMMAND_SET * 2];
+  features = *(uint16_t *) &id[ID_FEATURES * 2];
+  if (command_set != 0xffff && (command_set & ID_COMMAND_SET_LBA48))
+    {
+      d->lba48 = true;
+      capacity = *(uint64_t *) &id[ID_CAPACITY_LBA48 * 2];
+      if (capacity > (block_sector_t) -1)
+        {
+          printf ("%s: using only first %"PRDSNu" sectors\n",
+                  d->name, (block_sector_t) -1);
+          capacity = (block_sector_t) -1;
+        }
+    }
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
@@ -292,23 +336,46 @@ identify_ata_device (struct ata_disk *d)
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
      allow access to those, we're less likely to scribble on
-     someone's important data.  You can disable this check by
-     hand if you really want to do so. */
-  if (capacity >= 1024 * 1024 * 1024 / BLOCK_SECTOR_SIZE)
+     someone's important data.  You can disable this check with
+     the "-bigdisks" kernel option if you really want to. */
+  if (capacity >= 1024 * 1024 * 1024 / BLOCK_SECTOR_SIZE && !ide_big_disks)
     {
       printf ("%s: ignoring ", d->name);
-      print_human_readable_size (capacity * 512);
-      printf ("disk for safety\n");
+      print_human_readable_size (capacity * BLOCK_SECTOR_SIZE);
+      printf ("disk for safety (use -bigdisks to override)\n");
       d->is_ata = false;
       return;
     }
 
+  /* Let the disk acknowledge writes as soon as they are in its
+     cache.  ide_flush() then makes them durable. */
+  if (features != 0xffff && (features & ID_FEATURES_WCACHE))
+    enable_write_cache (d);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Sends a SET FEATURES command to disk D to enable its write
+   cache. */
+static void
+enable_write_cache (struct ata_disk *d)
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_features (c), FEAT_ENABLE_WCACHE);
+  issue_pio_command (c, CMD_SET_FEATURES);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if (inb (reg_status (c)) & STA_ERR)
+    printf ("%s: failed to enable write cache\n", d->name);
+  else
+    d->write_cache = true;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -348,7 +415,8 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
   select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+  issue_pio_command (c, (d->lba48
+                         ? CMD_READ_SECTOR_EXT : CMD_READ_SECTOR_RETRY));
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
     PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
@@ -358,7 +426,8 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
    BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+   acknowledged receiving the data, which may then still be in
+   its write cache.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
@@ -368,7 +437,8 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
   select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+  issue_pio_command (c, (d->lba48
+                         ? CMD_WRITE_SECTOR_EXT : CMD_WRITE_SECTOR_RETRY));
   if (!wait_while_busy (d))
     PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
   output_sector (c, buffer);
@@ -376,29 +446,68 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
   lock_release (&c->lock);
 }
 
+/* Sends a FLUSH CACHE command to disk D and waits for it to
+   write its cache to the media.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_flush (void *d_)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+
+  if (!d->write_cache)
+    return;
+
+  lock_acquire (&c->lock);
+  select_device_wait (d);
+  issue_pio_command (c, d->lba48 ? CMD_FLUSH_CACHE_EXT : CMD_FLUSH_CACHE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if (inb (reg_status (c)) & STA_ERR)
+    PANIC ("%s: disk cache flush failed", d->name);
+  lock_release (&c->lock);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    NULL,                       /* No multi-sector reads. */
+    NULL,                       /* No multi-sector writes. */
+    ide_flush
   };
 
 /* Selects device D, waiting for it to become ready, and then
    writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   use LBA mode.)
+
+   For a disk that uses 48-bit commands, the sector count and
+   LBA registers are each a two-byte FIFO: the first write sets
+   the high-order byte and the second the low-order byte. */
 static void
 select_sector (struct ata_disk *d, block_sector_t sec_no)
 {
   struct channel *c = d->channel;
+  uint8_t dev = DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0);
 
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (d->lba48 || sec_no < (1UL << 28));
   
   select_device_wait (d);
+  if (d->lba48)
+    {
+      outb (reg_nsect (c), 0);
+      outb (reg_lbal (c), sec_no >> 24);
+      outb (reg_lbam (c), 0);
+      outb (reg_lbah (c), 0);
+    }
+  else
+    dev |= sec_no >> 24;
   outb (reg_nsect (c), 1);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
-  outb (reg_lbah (c), (sec_no >> 16));
-  outb (reg_device (c),
-        DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
+  outb (reg_lbah (c), sec_no >> 16);
+  outb (reg_device (c), dev);
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
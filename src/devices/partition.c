@@ -317,8 +317,44 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Reads CNT consecutive sectors starting at SECTOR from
+   partition P into BUFFER, which must have room for
+   CNT * BLOCK_SECTOR_SIZE bytes. */
+static void
+partition_read_multiple (void *p_, block_sector_t sector, void *buffer,
+                         size_t cnt)
+{
+  struct partition *p = p_;
+  block_read_multiple (p->block, p->start + sector, buffer, cnt);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to
+   partition P from BUFFER, which must contain
+   CNT * BLOCK_SECTOR_SIZE bytes.  Returns after the block has
+   acknowledged receiving the data. */
+static void
+partition_write_multiple (void *p_, block_sector_t sector,
+                          const void *buffer, size_t cnt)
+{
+  struct partition *p = p_;
+  block_write_multiple (p->block, p->start + sector, buffer, cnt);
+}
+
+/* Flushes the write cache of the device containing partition
+   P.  (Devices cannot flush only part of their cache, so this
+   flushes writes to other partitions as well.) */
+static void
+partition_flush (void *p_)
+{
+  struct partition *p = p_;
+  block_flush (p->block);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_multiple,
+    partition_write_multiple,
+    partition_flush
   };
@@ -0,0 +1,92 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/io.h"
+
+/* Interface to PCI configuration space, using configuration
+   mechanism #1, which every PC chipset that Pintos might run on
+   supports.  See [PCI] section 3.2.2.3.2 for details.  Only
+   enough is provided to find devices and set them up; device
+   drivers do the rest. */
+
+/* Configuration mechanism #1 I/O ports. */
+#define PCI_CONFIG_ADDR 0xcf8   /* Selects configuration register. */
+#define PCI_CONFIG_DATA 0xcfc   /* Contains the selected register. */
+
+/* Enable bit in PCI_CONFIG_ADDR. */
+#define PCI_CONFIG_ENABLE 0x80000000
+
+/* Header type bit indicating a multifunction device. */
+#define PCI_HEADER_MULTIFUNC 0x80
+
+/* Vendor ID read back from an empty slot. */
+#define PCI_VENDOR_NONE 0xffff
+
+/* Selects 32-bit configuration register REG of function A.
+   Must be called with interrupts off. */
+static void
+select_register (struct pci_address a, uint8_t reg)
+{
+  ASSERT (a.dev < 32 && a.func < 8);
+  ASSERT (reg % 4 == 0);
+
+  outl (PCI_CONFIG_ADDR, (PCI_CONFIG_ENABLE | (a.bus << 16) | (a.dev << 11)
+                          | (a.func << 8) | reg));
+}
+
+/* Returns the 32-bit configuration register REG of function A. */
+uint32_t
+pci_read_config (struct pci_address a, uint8_t reg)
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t value;
+
+  select_register (a, reg);
+  value = inl (PCI_CONFIG_DATA);
+  intr_set_level (old_level);
+
+  return value;
+}
+
+/* Sets the 32-bit configuration register REG of function A to
+   VALUE. */
+void
+pci_write_config (struct pci_address a, uint8_t reg, uint32_t value)
+{
+  enum intr_level old_level = intr_disable ();
+
+  select_register (a, reg);
+  outl (PCI_CONFIG_DATA, value);
+  intr_set_level (old_level);
+}
+
+/* Calls FUNC, passing AUX, for each function present on every
+   PCI bus, in bus, device, function order. */
+void
+pci_scan (pci_scan_func *func, void *aux)
+{
+  int bus, dev, fn;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++)
+      for (fn = 0; fn < 8; fn++)
+        {
+          struct pci_address a = { bus, dev, fn };
+          uint32_t id = pci_read_config (a, PCI_REG_ID);
+
+          if ((id & 0xffff) == PCI_VENDOR_NONE)
+            {
+              /* Function 0 must exist if any function does. */
+              if (fn == 0)
+                break;
+              continue;
+            }
+          func (a, id & 0xffff, id >> 16, aux);
+
+          /* Only multifunction devices have functions 1...7. */
+          if (fn == 0
+              && !((pci_read_config (a, PCI_REG_HEADER) >> 16)
+                   & PCI_HEADER_MULTIFUNC))
+            break;
+        }
+}
@@ -0,0 +1,41 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Location of a PCI function in configuration space. */
+struct pci_address
+  {
+    uint8_t bus;                /* Bus number, 0...255. */
+    uint8_t dev;                /* Device number, 0...31. */
+    uint8_t func;               /* Function number, 0...7. */
+  };
+
+/* Standard configuration space registers. */
+#define PCI_REG_ID 0x00         /* Device ID (31:16), vendor ID (15:0). */
+#define PCI_REG_COMMAND 0x04    /* Status (31:16), command (15:0). */
+#define PCI_REG_HEADER 0x0c     /* Header type in bits 23:16. */
+#define PCI_REG_BAR0 0x10       /* First base address register. */
+#define PCI_REG_INTR 0x3c       /* Interrupt line in bits 7:0. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MEM 0x0002      /* Respond to memory space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* Allow bus mastering (DMA). */
+
+/* Base address register bits. */
+#define PCI_BAR_IO 0x1          /* 1=I/O space BAR, 0=memory BAR. */
+#define PCI_BAR_IO_MASK 0xfffffffc  /* I/O port base address. */
+
+uint32_t pci_read_config (struct pci_address, uint8_t reg);
+void pci_write_config (struct pci_address, uint8_t reg, uint32_t value);
+
+/* Called for each PCI function found by pci_scan(), with its
+   ADDRESS, VENDOR and DEVICE IDs, and the AUX passed to
+   pci_scan(). */
+typedef void pci_scan_func (struct pci_address address,
+                            uint16_t vendor, uint16_t device, void *aux);
+void pci_scan (pci_scan_func *, void *aux);
+
+#endif /* devices/pci.h */
@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,50 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts CHANNEL counting down COUNT PIT cycles, between 1 and
+   PIT_COUNT_MAX, in mode 0 ("interrupt on terminal count").  The
+   channel's output goes high once, when the count runs out, and
+   stays high until the channel is reprogrammed.  For channel 0,
+   that raises a single timer interrupt. */
+void
+pit_start_oneshot (int channel, uint32_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (count >= 1 && count <= PIT_COUNT_MAX);
+
+  /* A count of 0 is treated as PIT_COUNT_MAX. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the number of PIT cycles left in CHANNEL's current
+   count.  If EXPIRED is nonnull, stores in it whether the
+   channel's output is high, which for a one-shot count means that
+   it has run out.  Uses the 8254 read-back command, which latches
+   the status and the count at the same instant. */
+uint32_t
+pit_read_count (int channel, bool *expired)
+{
+  enum intr_level old_level;
+  uint8_t status;
+  uint32_t count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xc0 | (1 << (channel + 1)));
+  status = inb (PIT_PORT_COUNTER (channel));
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+
+  if (expired != NULL)
+    *expired = (status & 0x80) != 0;
+  return count != 0 ? count : PIT_COUNT_MAX;
+}
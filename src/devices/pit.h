@@ -1,8 +1,17 @@
 #ifndef DEVICES_PIT_H
 #define DEVICES_PIT_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+/* PIT cycles per second. */
+#define PIT_HZ 1193180
+
+/* Largest count that can be loaded into a PIT channel. */
+#define PIT_COUNT_MAX 65536
+
 void pit_configure_channel (int channel, int mode, int frequency);
+void pit_start_oneshot (int channel, uint32_t count);
+uint32_t pit_read_count (int channel, bool *expired);
 
 #endif /* devices/pit.h */
@@ -0,0 +1,126 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A RAM disk: a block device whose sectors are kept in memory
+   instead of on a disk.  Accessing it costs only a memcpy(), so
+   a file system on a RAM disk can be used to measure file
+   system overhead separately from device overhead, or as fast
+   scratch or swap space whose contents do not survive a
+   reboot.
+
+   The RAM disk's memory either comes from the kernel page pool,
+   one page at a time, or is a physically contiguous region of
+   RAM given on the kernel command line.  In the latter case the
+   region's contents are not cleared, so it can hold a disk
+   image loaded by the boot environment. */
+
+/* Number of sectors in a page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    uint8_t **pages;            /* Kernel virtual address of each page. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+static struct ramdisk ramdisk;
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk of SIZE bytes, rounded up to a whole number
+   of pages, and registers it as block device "ram0".  If PADDR
+   is 0, the disk's memory is taken from the kernel pool and
+   zeroed; otherwise the disk uses the physical memory starting
+   at page-aligned address PADDR, which must not have been
+   allocated already.  Does nothing if SIZE is 0. */
+void
+ramdisk_init (size_t size, uintptr_t paddr)
+{
+  struct ramdisk *rd = &ramdisk;
+  char extra_info[64];
+  size_t i;
+
+  if (size == 0)
+    return;
+
+  rd->page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  rd->pages = malloc (rd->page_cnt * sizeof *rd->pages);
+  if (rd->pages == NULL)
+    PANIC ("ramdisk: out of memory for page table");
+
+  if (paddr == 0)
+    {
+      for (i = 0; i < rd->page_cnt; i++)
+        {
+          rd->pages[i] = palloc_get_page (PAL_ZERO);
+          if (rd->pages[i] == NULL)
+            PANIC ("ramdisk: out of memory after %zu of %zu pages",
+                   i, rd->page_cnt);
+        }
+      snprintf (extra_info, sizeof extra_info, "kernel pages");
+    }
+  else
+    {
+      uint8_t *base;
+
+      if (paddr % PGSIZE != 0
+          || paddr / PGSIZE + rd->page_cnt > init_ram_pages)
+        PANIC ("ramdisk: region at %#"PRIxPTR" is not page-aligned "
+               "or extends past end of RAM", paddr);
+      base = ptov (paddr);
+      if (!palloc_reserve (base, rd->page_cnt))
+        PANIC ("ramdisk: region at %#"PRIxPTR" is already in use", paddr);
+      for (i = 0; i < rd->page_cnt; i++)
+        rd->pages[i] = base + i * PGSIZE;
+      snprintf (extra_info, sizeof extra_info,
+                "physical memory at %#"PRIxPTR, paddr);
+    }
+
+  block_register ("ram0", BLOCK_RAW, extra_info,
+                  rd->page_cnt * SECTORS_PER_PAGE, &ramdisk_operations, rd);
+}
+
+/* Returns the address of sector SEC_NO in RAM disk RD. */
+static uint8_t *
+sector_address (const struct ramdisk *rd, block_sector_t sec_no)
+{
+  ASSERT (sec_no / SECTORS_PER_PAGE < rd->page_cnt);
+  return (rd->pages[sec_no / SECTORS_PER_PAGE]
+          + sec_no % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads sector SEC_NO from RAM disk RD into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_read (void *rd_, block_sector_t sec_no, void *buffer)
+{
+  struct ramdisk *rd = rd_;
+  memcpy (buffer, sector_address (rd, sec_no), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes sector SEC_NO to RAM disk RD from BUFFER, which must
+   contain BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_write (void *rd_, block_sector_t sec_no, const void *buffer)
+{
+  struct ramdisk *rd = rd_;
+  memcpy (sector_address (rd, sec_no), buffer, BLOCK_SECTOR_SIZE);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    NULL,                       /* No multi-sector reads. */
+    NULL,                       /* No multi-sector writes. */
+    NULL                        /* No write cache to flush. */
+  };
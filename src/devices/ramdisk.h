@@ -0,0 +1,9 @@
+#ifndef DEVICES_RAMDISK_H
+#define DEVICES_RAMDISK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+void ramdisk_init (size_t size, uintptr_t paddr);
+
+#endif /* devices/ramdisk.h */
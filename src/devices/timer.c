@@ -4,6 +4,8 @@
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
+#include "devices/tsc.h"
+#include <list.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
@@ -20,21 +22,89 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* If true, the idle thread stops the periodic timer interrupt
+   while nothing is runnable and sets a one-shot count for the
+   next tick with work to do instead ("tickless idle").
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles per timer tick, rounded as pit_configure_channel()
+   rounds them. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Number of ticks covered by the one-shot count that
+   timer_idle() set, or 0 while the timer is periodic. */
+static int oneshot_ticks;
+
+/* Sleeping threads are kept in a hierarchical timing wheel, as
+   in the classic BSD and Linux timer implementations.  Level 0
+   has one bucket per tick for the next WHEEL0_SIZE ticks.  Each
+   higher level has WHEELN_SIZE buckets, each spanning a whole
+   rotation of the level below.  Sleeping and waking are O(1).
+   When level 0 wraps around, the next bucket of level 1 is
+   "cascaded" down, that is, its threads are redistributed to the
+   level that now matches their remaining time, and so on up.
+   The timer interrupt therefore only looks at buckets that are
+   due.
+
+   A sleeping thread is linked into a bucket through its `elem',
+   which is otherwise unused while it is blocked. */
+#define WHEEL0_BITS 8
+#define WHEELN_BITS 6
+#define WHEEL0_SIZE (1 << WHEEL0_BITS)
+#define WHEELN_SIZE (1 << WHEELN_BITS)
+#define WHEEL_LEVELS 4                  /* Including level 0. */
+
+static struct list wheel0[WHEEL0_SIZE];
+static struct list wheeln[WHEEL_LEVELS - 1][WHEELN_SIZE];
+
+/* Next tick whose level-0 bucket has not been run yet. */
+static int64_t wheel_ticks;
+
+static void wheel_insert (struct thread *);
+static void wheel_advance (void);
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* High-resolution clocksource.  The time-stamp counter is
+   measured against the PIT by timer_calibrate(), over
+   TSC_CALIBRATE_TICKS timer ticks.  Until then tsc_hz is 0 and
+   timer_ns() only has timer tick resolution. */
+#define TSC_CALIBRATE_TICKS (TIMER_FREQ / 10)
+#define NS_PER_SEC 1000000000LL
+static uint64_t tsc_hz;         /* TSC cycles per second. */
+static uint64_t tsc_base;       /* TSC value at timer_init(). */
+
+/* A tick and its time by timer_ns(), from which
+   real_time_sleep() works out when later ticks will come.  Set
+   by each timer interrupt and whenever the PIT is re-armed. */
+static int64_t last_tick;
+static int64_t last_tick_ns;
+
 static intr_handler_func timer_interrupt;
+static void timer_tick (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static void tsc_calibrate (void);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  int i, j;
+
+  for (i = 0; i < WHEEL0_SIZE; i++)
+    list_init (&wheel0[i]);
+  for (i = 0; i < WHEEL_LEVELS - 1; i++)
+    for (j = 0; j < WHEELN_SIZE; j++)
+      list_init (&wheeln[i][j]);
+
+  tsc_base = tsc_read ();
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -64,6 +134,31 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  tsc_calibrate ();
+  printf ("TSC runs at %'"PRIu64" cycles/s.\n", tsc_hz);
+}
+
+/* Measures tsc_hz by counting TSC cycles across
+   TSC_CALIBRATE_TICKS timer ticks, starting on a tick edge. */
+static void
+tsc_calibrate (void) 
+{
+  int64_t start;
+  uint64_t tsc_start;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+
+  tsc_start = tsc_read ();
+  start = ticks;
+  while (ticks - start < TSC_CALIBRATE_TICKS)
+    barrier ();
+
+  tsc_hz = (tsc_read () - tsc_start) * TIMER_FREQ / TSC_CALIBRATE_TICKS;
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -84,26 +179,47 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the number of nanoseconds since timer_init(), with TSC
+   resolution once timer_calibrate() has run.  Monotonic. */
+int64_t
+timer_ns (void) 
+{
+  if (tsc_hz == 0)
+    return timer_ticks () * (NS_PER_SEC / TIMER_FREQ);
+  return timer_cycles_to_ns (tsc_read () - tsc_base);
+}
+
+/* Converts CYCLES, a difference between two tsc_read() values,
+   into nanoseconds.  Returns 0 before timer_calibrate(). */
+int64_t
+timer_cycles_to_ns (uint64_t cycles) 
+{
+  if (tsc_hz == 0)
+    return 0;
+
+  /* Split the division so that the product cannot overflow. */
+  return (cycles / tsc_hz) * NS_PER_SEC
+          + (cycles % tsc_hz) * NS_PER_SEC / tsc_hz;
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
 timer_sleep (int64_t sleep_ticks) 
 {
+  struct thread *cur = thread_current ();
   enum intr_level old_level;
-  
-  int64_t start = timer_ticks ();
-  
-  old_level = intr_disable ();
 
-  int64_t last_tick = start + sleep_ticks;
-  struct thread *current_thread = thread_current();
-  current_thread->final_tick = (long long) last_tick;
-  intr_set_level (old_level);
-  
   ASSERT (intr_get_level () == INTR_ON);
-  sema_tick_ordered_down(current_thread->sleep_sema);
 
-  
+  if (sleep_ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->final_tick = ticks + sleep_ticks;
+  wheel_insert (cur);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -179,11 +295,182 @@ timer_print_stats (void)
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
+{
+  timer_tick ();
+  last_tick = ticks;
+  last_tick_ns = timer_ns ();
+}
+
+/* Accounts for one timer tick. */
+static void
+timer_tick (void) 
 {
   ticks++;
+  wheel_advance ();
   thread_tick ();
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  In tickless mode, replaces the periodic timer
+   interrupt with a single one at the next tick that has a sleeper
+   to wake or a wheel level to cascade, so that an idle machine
+   is not woken TIMER_FREQ times a second for nothing.  A 16-bit
+   PIT count limits a one-shot to a few ticks at most. */
+void
+timer_idle (void) 
+{
+  uint32_t rem;
+  int max, n;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  /* REM cycles remain until the next tick, and then
+     TICK_CYCLES for each tick after it. */
+  rem = pit_read_count (0, NULL);
+  max = (PIT_COUNT_MAX - rem) / TICK_CYCLES + 1;
+  for (n = 1; n < max; n++) 
+    {
+      int index = (wheel_ticks + n - 1) & (WHEEL0_SIZE - 1);
+      if (index == 0 || !list_empty (&wheel0[index]))
+        break;
+    }
+  if (n < 2)
+    return;
+
+  pit_start_oneshot (0, rem + (n - 1) * TICK_CYCLES);
+  oneshot_ticks = n;
+}
+
+/* Called on entry to every external interrupt.  If timer_idle()
+   stopped the periodic tick, accounts for the ticks that went by
+   while the CPU was halted and puts the timer back on a tick
+   boundary. */
+void
+timer_irq_enter (void) 
+{
+  uint32_t count, next;
+  bool expired;
+  int passed;
+
+  ASSERT (intr_context ());
+
+  if (oneshot_ticks == 0)
+    return;
+
+  count = pit_read_count (0, &expired);
+  if (expired) 
+    {
+      /* The whole count went by.  Its last tick belongs to
+         timer_interrupt(), which is either running now or
+         pending. */
+      passed = oneshot_ticks - 1;
+      oneshot_ticks = 0;
+      next = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+  else 
+    {
+      /* Woken early by another device.  Catch up on the ticks
+         gone by and count down to the next tick boundary, whose
+         interrupt restarts the periodic tick as above. */
+      int left = DIV_ROUND_UP (count, TICK_CYCLES);
+      passed = oneshot_ticks - left;
+      oneshot_ticks = 1;
+      next = count - (left - 1) * TICK_CYCLES;
+      pit_start_oneshot (0, next);
+    }
+
+  while (passed-- > 0)
+    timer_tick ();
+
+  /* Re-arming the PIT moved the tick phase.  Tick TICKS + 1
+     comes NEXT cycles from now. */
+  last_tick = ticks + 1;
+  last_tick_ns = timer_ns () + next * NS_PER_SEC / PIT_HZ;
+}
+
+/* Adds sleeping thread T to the bucket of the timing wheel that
+   covers its wake-up tick.  Interrupts must be off. */
+static void
+wheel_insert (struct thread *t) 
+{
+  int64_t expires = t->final_tick;
+  int64_t delta = expires - wheel_ticks;
+  struct list *bucket;
+  int level;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (delta < 0)
+    {
+      /* Already due: run it with the current tick. */
+      bucket = &wheel0[wheel_ticks & (WHEEL0_SIZE - 1)];
+    }
+  else if (delta < WHEEL0_SIZE)
+    bucket = &wheel0[expires & (WHEEL0_SIZE - 1)];
+  else 
+    {
+      for (level = 1; level < WHEEL_LEVELS - 1; level++)
+        if (delta < (int64_t) 1 << (WHEEL0_BITS + level * WHEELN_BITS))
+          break;
+
+      /* Sleeps beyond the wheel's span wait in the last bucket of
+         the top level and are re-filed when it cascades. */
+      if (delta >= (int64_t) 1 << (WHEEL0_BITS
+                                   + (WHEEL_LEVELS - 1) * WHEELN_BITS))
+        expires = wheel_ticks + ((int64_t) 1 << (WHEEL0_BITS
+                                 + (WHEEL_LEVELS - 1) * WHEELN_BITS)) - 1;
+
+      bucket = &wheeln[level - 1][(expires >> (WHEEL0_BITS
+                                               + (level - 1) * WHEELN_BITS))
+                                  & (WHEELN_SIZE - 1)];
+    }
+  list_push_back (bucket, &t->elem);
+}
+
+/* Re-files every thread in bucket INDEX of level LEVEL (1 or
+   more) into the lower levels.  Returns INDEX, so that the caller
+   knows whether this level has wrapped around too. */
+static int
+wheel_cascade (int level, int index) 
+{
+  struct list *bucket = &wheeln[level - 1][index];
+
+  while (!list_empty (bucket))
+    wheel_insert (list_entry (list_pop_front (bucket), struct thread, elem));
+  return index;
+}
+
+/* Wakes the threads whose sleep ends at or before the current
+   tick.  Called from the timer interrupt. */
+static void
+wheel_advance (void) 
+{
+  while (wheel_ticks <= ticks) 
+    {
+      int index = wheel_ticks & (WHEEL0_SIZE - 1);
+      struct list *bucket = &wheel0[index];
+      int level;
+
+      if (index == 0)
+        for (level = 1; level < WHEEL_LEVELS; level++)
+          {
+            int shift = WHEEL0_BITS + (level - 1) * WHEELN_BITS;
+            if (wheel_cascade (level, (wheel_ticks >> shift)
+                                      & (WHEELN_SIZE - 1)) != 0)
+              break;
+          }
+      wheel_ticks++;
+
+      while (!list_empty (bucket))
+        thread_unblock (list_entry (list_pop_front (bucket),
+                                    struct thread, elem));
+    }
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
@@ -230,7 +517,29 @@ real_time_sleep (int64_t num, int32_t denom)
   int64_t ticks = num * TIMER_FREQ / denom;
 
   ASSERT (intr_get_level () == INTR_ON);
-  if (ticks > 0)
+  if (tsc_hz != 0)
+    {
+      /* Sleep until the last tick before the deadline, working
+         out when that is afresh after each wakeup, then spin on
+         the TSC for the sub-tick remainder. */
+      int64_t deadline = timer_ns () + num * (NS_PER_SEC / denom);
+
+      for (;;) 
+        {
+          enum intr_level old_level = intr_disable ();
+          int64_t wake = (last_tick + (deadline - last_tick_ns)
+                          / (NS_PER_SEC / TIMER_FREQ));
+          int64_t sleep_ticks = wake - timer_ticks ();
+          intr_set_level (old_level);
+
+          if (sleep_ticks <= 0)
+            break;
+          timer_sleep (sleep_ticks);
+        }
+      while (timer_ns () < deadline)
+        barrier ();
+    }
+  else if (ticks > 0)
     {
       /* We're waiting for at least one full timer tick.  Use
          timer_sleep() because it will yield the CPU to other
@@ -252,7 +561,18 @@ real_time_delay (int64_t num, int32_t denom)
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT (denom % 1000 == 0);
-  busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000)); 
+  if (tsc_hz != 0)
+    {
+      /* Spin on the TSC, which does not depend on how the loop
+         below happens to be aligned or inlined. */
+      uint64_t start = tsc_read ();
+      uint64_t cycles = tsc_hz / 1000 * num / (denom / 1000);
+
+      while (tsc_read () - start < cycles)
+        barrier ();
+    }
+  else
+    busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000)); 
 }
 
 
@@ -0,0 +1,21 @@
+#ifndef DEVICES_TSC_H
+#define DEVICES_TSC_H
+
+#include <stdint.h>
+
+/* Returns the current value of the CPU's time-stamp counter,
+   which counts processor clock cycles since reset.  Reading it
+   is much cheaper than reading the PIT and has far finer
+   resolution than a timer tick, so it is suitable for timing
+   short operations such as individual disk requests.
+
+   See [IA32-v2b] "RDTSC". */
+static inline uint64_t
+tsc_read (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* devices/tsc.h */
@@ -0,0 +1,511 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is a driver for virtio block devices,
+   such as those QEMU provides with "-drive if=virtio".  It uses
+   the legacy PCI transport and split virtqueues described in
+   [VIRTIO] sections 4.1.4.8 and 2.6.
+
+   Unlike an IDE channel, which carries out one PIO command at a
+   time, a virtio device accepts as many requests as there are
+   free descriptors in its virtqueue and completes them in any
+   order.  Each thread that reads or writes a virtio disk puts a
+   request on the queue and sleeps until the interrupt handler
+   reports that the device has completed it, so up to MAX_REQS
+   requests from different threads can be outstanding at once.
+   Data moves by DMA, so a request of many sectors costs the
+   same single notification and interrupt as a request of one. */
+
+/* PCI IDs of a legacy (or transitional) virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_DEVICE_BLK 0x1001
+
+/* Legacy virtio registers, in the I/O space given by BAR0. */
+#define reg_device_features(D) ((D)->io_base + 0x00) /* Features (r/o). */
+#define reg_guest_features(D) ((D)->io_base + 0x04)  /* Accepted features. */
+#define reg_queue_pfn(D) ((D)->io_base + 0x08)       /* Queue page number. */
+#define reg_queue_size(D) ((D)->io_base + 0x0c)      /* Queue size (r/o). */
+#define reg_queue_select(D) ((D)->io_base + 0x0e)    /* Queue selector. */
+#define reg_queue_notify(D) ((D)->io_base + 0x10)    /* Queue notifier. */
+#define reg_status(D) ((D)->io_base + 0x12)          /* Device status. */
+#define reg_isr(D) ((D)->io_base + 0x13)             /* ISR (r/o, clears). */
+#define reg_capacity(D) ((D)->io_base + 0x14)        /* Sectors (64 bits). */
+
+/* Device status register bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Guest has noticed the device. */
+#define STATUS_DRIVER 0x02      /* Guest knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+#define STATUS_FAILED 0x80      /* Driver gave up on the device. */
+
+/* Feature bits. */
+#define VIRTIO_BLK_F_FLUSH (1u << 9)    /* Flush command supported. */
+
+/* Virtqueue descriptor flags. */
+#define VRING_DESC_F_NEXT 0x1   /* Buffer continues in NEXT. */
+#define VRING_DESC_F_WRITE 0x2  /* Device writes (vs. reads) buffer. */
+
+/* The legacy transport requires the used ring to start on a
+   page boundary. */
+#define VRING_ALIGN 4096
+
+/* Block request types and status codes. */
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+#define VIRTIO_BLK_T_FLUSH 4    /* Flush write cache. */
+#define VIRTIO_BLK_S_OK 0       /* Success. */
+
+/* Each request uses a chain of three descriptors: the request
+   header, the data buffer, and the status byte. */
+#define DESCS_PER_REQ 3
+
+/* Maximum number of requests outstanding on one disk. */
+#define MAX_REQS 64
+
+/* Maximum number of sectors transferred by one request. */
+#define MAX_REQ_SECTORS 128
+
+/* Virtqueue descriptor.  See [VIRTIO] 2.6.5. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address of buffer. */
+    uint32_t len;               /* Length of buffer in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_*. */
+    uint16_t next;              /* Next descriptor, with F_NEXT. */
+  };
+
+/* Available ring, written by the driver.  See [VIRTIO] 2.6.6. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the driver puts the next entry. */
+    uint16_t ring[];            /* Heads of descriptor chains. */
+  };
+
+/* Used ring element. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head of completed descriptor chain. */
+    uint32_t len;               /* Bytes written by the device. */
+  };
+
+/* Used ring, written by the device.  See [VIRTIO] 2.6.8. */
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the device puts the next entry. */
+    struct vring_used_elem ring[];
+  };
+
+/* Header of a block request, read by the device. */
+struct virtio_blk_outhdr
+  {
+    uint32_t type;              /* VIRTIO_BLK_T_*. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector to transfer. */
+  };
+
+/* A request slot.  Slot I always uses the descriptors starting
+   at I * DESCS_PER_REQ. */
+struct request
+  {
+    struct virtio_blk_outhdr hdr;       /* Header, read by the device. */
+    uint8_t status;                     /* Status, written by the device. */
+    struct semaphore done;              /* Up'd by interrupt handler. */
+    struct list_elem free_elem;         /* Element in free_reqs. */
+  };
+
+/* A virtio block device. */
+struct virtio_disk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* Base I/O port. */
+    uint8_t irq;                /* Interrupt in use. */
+    bool flush;                 /* Has a write cache to flush? */
+
+    uint16_t queue_size;        /* Number of descriptors in virtqueue. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    volatile struct vring_avail *avail;  /* Available ring. */
+    volatile struct vring_used *used;    /* Used ring. */
+    uint16_t last_used;         /* Used ring index processed so far. */
+
+    struct request *reqs;       /* Request slots. */
+    size_t req_cnt;             /* Number of request slots. */
+    struct list free_reqs;      /* Request slots not in use. */
+    struct semaphore free_cnt;  /* Number of elements in free_reqs. */
+  };
+
+/* Number of virtio disks we support. */
+#define DISK_CNT 4
+static struct virtio_disk disks[DISK_CNT];
+static size_t disk_cnt;
+
+static struct block_operations virtio_operations;
+
+static pci_scan_func probe_device;
+static bool init_device (struct virtio_disk *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds virtio block devices on the PCI bus and registers them
+   with the block device layer. */
+void
+virtio_blk_init (void)
+{
+  pci_scan (probe_device, NULL);
+}
+
+/* If the PCI function at address A is a virtio block device,
+   initializes it and registers it as a block device. */
+static void
+probe_device (struct pci_address a, uint16_t vendor, uint16_t device,
+              void *aux UNUSED)
+{
+  struct virtio_disk *d;
+  struct block *block;
+  uint32_t bar, command, irq_line;
+  uint64_t capacity;
+  char extra_info[64];
+  size_t i;
+
+  if (vendor != VIRTIO_VENDOR || device != VIRTIO_DEVICE_BLK)
+    return;
+  if (disk_cnt >= DISK_CNT)
+    {
+      printf ("virtio-blk: too many disks, ignoring %02x:%02x.%x\n",
+              a.bus, a.dev, a.func);
+      return;
+    }
+  d = &disks[disk_cnt];
+  snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+
+  /* Find the device's registers and interrupt. */
+  bar = pci_read_config (a, PCI_REG_BAR0);
+  irq_line = pci_read_config (a, PCI_REG_INTR) & 0xff;
+  if (!(bar & PCI_BAR_IO) || irq_line >= 16)
+    {
+      printf ("%s: unusable I/O port or interrupt, ignoring\n", d->name);
+      return;
+    }
+  d->io_base = bar & PCI_BAR_IO_MASK;
+  d->irq = 0x20 + irq_line;
+
+  /* Let the device respond to I/O ports and do DMA. */
+  command = pci_read_config (a, PCI_REG_COMMAND) & 0xffff;
+  pci_write_config (a, PCI_REG_COMMAND,
+                    command | PCI_CMD_IO | PCI_CMD_MASTER);
+
+  if (!init_device (d))
+    return;
+  disk_cnt++;
+
+  /* Register interrupt handler, unless another virtio disk
+     already shares this interrupt. */
+  for (i = 0; i + 1 < disk_cnt; i++)
+    if (disks[i].irq == d->irq)
+      break;
+  if (i + 1 == disk_cnt)
+    intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+
+  /* Register. */
+  capacity = inl (reg_capacity (d));
+  capacity |= (uint64_t) inl (reg_capacity (d) + 4) << 32;
+  if (capacity > (block_sector_t) -1)
+    {
+      printf ("%s: using only first %"PRDSNu" sectors\n",
+              d->name, (block_sector_t) -1);
+      capacity = (block_sector_t) -1;
+    }
+  snprintf (extra_info, sizeof extra_info,
+            "virtio, %zu outstanding requests", d->req_cnt);
+  block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                          &virtio_operations, d);
+  partition_scan (block);
+}
+
+/* Resets disk D and sets up its virtqueue and request slots.
+   Returns true if successful, false on failure. */
+static bool
+init_device (struct virtio_disk *d)
+{
+  size_t used_ofs, ring_size, i;
+  uint32_t features;
+  uint8_t *ring;
+
+  /* Reset the device and tell it that we know how to drive it.
+     The only optional feature we use is the flush command, which
+     a device with a write cache offers so that it can
+     acknowledge writes before they are durable. */
+  outb (reg_status (d), 0);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  features = inl (reg_device_features (d)) & VIRTIO_BLK_F_FLUSH;
+  outl (reg_guest_features (d), features);
+  d->flush = features != 0;
+
+  /* Allocate the request virtqueue, queue 0, in physically
+     contiguous, zeroed pages, and tell the device where it is. */
+  outw (reg_queue_select (d), 0);
+  d->queue_size = inw (reg_queue_size (d));
+  if (d->queue_size < DESCS_PER_REQ)
+    {
+      printf ("%s: bad virtqueue size %"PRIu16"\n", d->name, d->queue_size);
+      goto fail;
+    }
+  used_ofs = ROUND_UP (sizeof (struct vring_desc) * d->queue_size
+                       + sizeof (struct vring_avail)
+                       + sizeof (uint16_t) * (d->queue_size + 1),
+                       VRING_ALIGN);
+  ring_size = used_ofs + ROUND_UP (sizeof (struct vring_used)
+                                   + (sizeof (struct vring_used_elem)
+                                      * d->queue_size)
+                                   + sizeof (uint16_t), VRING_ALIGN);
+  ring = palloc_get_multiple (PAL_ZERO, DIV_ROUND_UP (ring_size, PGSIZE));
+  if (ring == NULL)
+    {
+      printf ("%s: out of memory for virtqueue\n", d->name);
+      goto fail;
+    }
+  d->desc = (struct vring_desc *) ring;
+  d->avail = (struct vring_avail *) (ring + (sizeof (struct vring_desc)
+                                             * d->queue_size));
+  d->used = (struct vring_used *) (ring + used_ofs);
+  d->last_used = 0;
+  outl (reg_queue_pfn (d), vtop (ring) / VRING_ALIGN);
+
+  /* Set up request slots. */
+  d->req_cnt = d->queue_size / DESCS_PER_REQ;
+  if (d->req_cnt > MAX_REQS)
+    d->req_cnt = MAX_REQS;
+  d->reqs = malloc (d->req_cnt * sizeof *d->reqs);
+  if (d->reqs == NULL)
+    {
+      printf ("%s: out of memory for requests\n", d->name);
+      outl (reg_queue_pfn (d), 0);
+      palloc_free_multiple (ring, DIV_ROUND_UP (ring_size, PGSIZE));
+      goto fail;
+    }
+  list_init (&d->free_reqs);
+  for (i = 0; i < d->req_cnt; i++)
+    {
+      sema_init (&d->reqs[i].done, 0);
+      list_push_back (&d->free_reqs, &d->reqs[i].free_elem);
+    }
+  sema_init (&d->free_cnt, d->req_cnt);
+
+  outb (reg_status (d),
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  return true;
+
+ fail:
+  outb (reg_status (d), STATUS_FAILED);
+  return false;
+}
+
+/* Fills in descriptor DESC. */
+static void
+set_desc (struct vring_desc *desc, void *buffer, size_t size,
+          uint16_t flags, uint16_t next)
+{
+  desc->addr = vtop (buffer);
+  desc->len = size;
+  desc->flags = flags;
+  desc->next = next;
+}
+
+/* Asks disk D to carry out a request of the given TYPE for the
+   CNT sectors starting at SEC_NO, with data in BUFFER, which
+   must be a kernel virtual address, and waits for it to
+   complete.  CNT is 0 for a request that transfers no data, in
+   which case BUFFER is ignored. */
+static void
+do_request (struct virtio_disk *d, uint32_t type, block_sector_t sec_no,
+            void *buffer, size_t cnt)
+{
+  enum intr_level old_level;
+  struct request *r;
+  uint16_t head;
+  uint8_t status;
+
+  ASSERT (cnt == 0 || is_kernel_vaddr (buffer));
+  ASSERT (cnt <= MAX_REQ_SECTORS);
+
+  /* Claim a request slot, waiting for one if necessary. */
+  sema_down (&d->free_cnt);
+  old_level = intr_disable ();
+  r = list_entry (list_pop_front (&d->free_reqs), struct request, free_elem);
+  intr_set_level (old_level);
+
+  /* Build the request's descriptor chain. */
+  head = (r - d->reqs) * DESCS_PER_REQ;
+  r->hdr.type = type;
+  r->hdr.reserved = 0;
+  r->hdr.sector = sec_no;
+  r->status = 0xff;
+  set_desc (&d->desc[head], &r->hdr, sizeof r->hdr,
+            VRING_DESC_F_NEXT, cnt > 0 ? head + 1 : head + 2);
+  if (cnt > 0)
+    set_desc (&d->desc[head + 1], buffer, cnt * BLOCK_SECTOR_SIZE,
+              (VRING_DESC_F_NEXT
+               | (type == VIRTIO_BLK_T_IN ? VRING_DESC_F_WRITE : 0)),
+              head + 2);
+  set_desc (&d->desc[head + 2], &r->status, sizeof r->status,
+            VRING_DESC_F_WRITE, 0);
+
+  /* Make the chain available to the device, then notify it.
+     The device must see the ring entry before the new index. */
+  old_level = intr_disable ();
+  d->avail->ring[d->avail->idx % d->queue_size] = head;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (reg_queue_notify (d), 0);
+  intr_set_level (old_level);
+
+  /* Wait for completion and release the slot. */
+  sema_down (&r->done);
+  status = r->status;
+  old_level = intr_disable ();
+  list_push_back (&d->free_reqs, &r->free_elem);
+  intr_set_level (old_level);
+  sema_up (&d->free_cnt);
+
+  if (status != VIRTIO_BLK_S_OK)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu", status=%"PRIu8,
+           d->name, (type == VIRTIO_BLK_T_IN ? "read"
+                     : type == VIRTIO_BLK_T_OUT ? "write" : "flush"),
+           sec_no, status);
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER, reading if TYPE is VIRTIO_BLK_T_IN and writing if it
+   is VIRTIO_BLK_T_OUT. */
+static void
+transfer (struct virtio_disk *d, uint32_t type, block_sector_t sec_no,
+          void *buffer_, size_t cnt)
+{
+  uint8_t *buffer = buffer_;
+
+  if (is_kernel_vaddr (buffer))
+    {
+      /* Kernel virtual addresses map physical memory linearly,
+         so the device can access BUFFER directly. */
+      while (cnt > 0)
+        {
+          size_t chunk = cnt < MAX_REQ_SECTORS ? cnt : MAX_REQ_SECTORS;
+          do_request (d, type, sec_no, buffer, chunk);
+          sec_no += chunk;
+          buffer += chunk * BLOCK_SECTOR_SIZE;
+          cnt -= chunk;
+        }
+    }
+  else
+    {
+      /* The device can't use user virtual addresses, so copy
+         through a kernel buffer one sector at a time. */
+      uint8_t bounce[BLOCK_SECTOR_SIZE];
+
+      for (; cnt > 0; cnt--, sec_no++, buffer += BLOCK_SECTOR_SIZE)
+        {
+          if (type == VIRTIO_BLK_T_OUT)
+            memcpy (bounce, buffer, BLOCK_SECTOR_SIZE);
+          do_request (d, type, sec_no, bounce, 1);
+          if (type == VIRTIO_BLK_T_IN)
+            memcpy (buffer, bounce, BLOCK_SECTOR_SIZE);
+        }
+    }
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+virtio_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  transfer (d, VIRTIO_BLK_T_IN, sec_no, buffer, 1);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+virtio_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  transfer (d, VIRTIO_BLK_T_OUT, sec_no, (void *) buffer, 1);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes. */
+static void
+virtio_read_multiple (void *d, block_sector_t sec_no, void *buffer,
+                      size_t cnt)
+{
+  transfer (d, VIRTIO_BLK_T_IN, sec_no, buffer, cnt);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data. */
+static void
+virtio_write_multiple (void *d, block_sector_t sec_no, const void *buffer,
+                       size_t cnt)
+{
+  transfer (d, VIRTIO_BLK_T_OUT, sec_no, (void *) buffer, cnt);
+}
+
+/* Waits until disk D has written all the data it has
+   acknowledged to nonvolatile storage. */
+static void
+virtio_flush (void *d_)
+{
+  struct virtio_disk *d = d_;
+
+  if (d->flush)
+    do_request (d, VIRTIO_BLK_T_FLUSH, 0, NULL, 0);
+}
+
+static struct block_operations virtio_operations =
+  {
+    virtio_read,
+    virtio_write,
+    virtio_read_multiple,
+    virtio_write_multiple,
+    virtio_flush
+  };
+
+/* Virtio interrupt handler.  Wakes up the thread waiting for
+   each request that the device has completed since the last
+   interrupt. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  struct virtio_disk *d;
+
+  for (d = disks; d < disks + disk_cnt; d++)
+    if (d->irq == f->vec_no)
+      {
+        inb (reg_isr (d));              /* Acknowledge interrupt. */
+        barrier ();
+        while (d->last_used != d->used->idx)
+          {
+            uint32_t id = d->used->ring[d->last_used % d->queue_size].id;
+            sema_up (&d->reqs[id / DESCS_PER_REQ].done);
+            d->last_used++;
+            barrier ();
+          }
+      }
+}
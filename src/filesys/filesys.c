@@ -29,6 +29,7 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  block_flush (fs_device);
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -128,6 +129,7 @@ do_format (void)
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
+  block_flush (fs_device);
   printf ("done.\n");
 }
 
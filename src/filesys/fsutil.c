@@ -215,6 +215,7 @@ fsutil_append (char **argv)
   memset (buffer, 0, BLOCK_SECTOR_SIZE);
   block_write (dst, sector, buffer);
   block_write (dst, sector, buffer + 1);
+  block_flush (dst);
 
   /* Finish up. */
   file_close (src);
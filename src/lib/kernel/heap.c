@@ -0,0 +1,157 @@
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *,
+                               struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+static void detach (struct heap_elem *);
+
+/* Initializes HEAP as an empty heap ordered by LESS given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *heap, heap_less_func *less, void *aux)
+{
+  ASSERT (heap != NULL);
+  ASSERT (less != NULL);
+
+  heap->root = NULL;
+  heap->less = less;
+  heap->aux = aux;
+}
+
+/* Returns true if HEAP is empty, false otherwise. */
+bool
+heap_empty (const struct heap *heap)
+{
+  return heap->root == NULL;
+}
+
+/* Returns the greatest element in HEAP, or a null pointer if
+   HEAP is empty.  If more than one element is greatest, returns
+   one of them. */
+struct heap_elem *
+heap_top (const struct heap *heap)
+{
+  return heap->root;
+}
+
+/* Inserts ELEM, which must not be in any heap, into HEAP. */
+void
+heap_insert (struct heap *heap, struct heap_elem *elem)
+{
+  ASSERT (elem != NULL);
+
+  elem->child = elem->next = elem->prev = NULL;
+  heap->root = meld (heap, heap->root, elem);
+}
+
+/* Removes ELEM, which must be in HEAP, from HEAP. */
+void
+heap_remove (struct heap *heap, struct heap_elem *elem)
+{
+  struct heap_elem *children;
+
+  ASSERT (elem != NULL);
+
+  if (elem != heap->root)
+    detach (elem);
+  children = merge_pairs (heap, elem->child);
+  heap->root = meld (heap, elem != heap->root ? heap->root : NULL,
+                     children);
+  elem->child = elem->next = elem->prev = NULL;
+}
+
+/* Restores HEAP's ordering after the value of ELEM, which must
+   be in HEAP, has increased. */
+void
+heap_increase (struct heap *heap, struct heap_elem *elem)
+{
+  ASSERT (elem != NULL);
+
+  if (elem != heap->root)
+    {
+      detach (elem);
+      heap->root = meld (heap, heap->root, elem);
+    }
+}
+
+/* Combines the trees rooted at A and B, either of which may be
+   null, by making the lesser root the first child of the
+   greater.  Returns the root of the combined tree.  The sibling
+   links of A and B must be null. */
+static struct heap_elem *
+meld (struct heap *heap, struct heap_elem *a, struct heap_elem *b)
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (heap->less (a, b, heap->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  b->prev = a;
+  a->child = b;
+  return a;
+}
+
+/* Combines the sibling trees starting at FIRST into one and
+   returns its root, or a null pointer if FIRST is null.  The
+   standard two passes, melding siblings pairwise left to right
+   and then the pairs right to left, give pairing heaps their
+   O(log n) amortized bound. */
+static struct heap_elem *
+merge_pairs (struct heap *heap, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  /* First pass.  The melded pairs form a stack through their
+     `next' links, so the second pass sees them in reverse. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      first = b != NULL ? b->next : NULL;
+      a->next = a->prev = NULL;
+      if (b != NULL)
+        b->next = b->prev = NULL;
+
+      a = meld (heap, a, b);
+      a->next = pairs;
+      pairs = a;
+    }
+
+  /* Second pass. */
+  while (pairs != NULL)
+    {
+      struct heap_elem *next = pairs->next;
+      pairs->next = NULL;
+      root = meld (heap, pairs, root);
+      pairs = next;
+    }
+  return root;
+}
+
+/* Unlinks ELEM, which must not be a root, from its parent and
+   siblings, keeping its own children. */
+static void
+detach (struct heap_elem *elem)
+{
+  ASSERT (elem->prev != NULL);
+
+  if (elem->prev->child == elem)
+    elem->prev->child = elem->next;
+  else
+    elem->prev->next = elem->next;
+  if (elem->next != NULL)
+    elem->next->prev = elem->prev;
+  elem->next = elem->prev = NULL;
+}
@@ -0,0 +1,62 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Max-heap.
+
+   This is a pairing heap: each element has a list of children,
+   all no greater than it, and the heap is the single tree whose
+   root is the greatest element.  Inserting an element or
+   increasing its key takes O(1) time, and removing any element
+   takes O(log n) amortized time.
+
+   Like lists and hash tables, heaps do not use dynamic
+   allocation.  Each structure that can potentially be in a heap
+   must embed a struct heap_elem member, and the heap_entry macro
+   converts from a struct heap_elem back to the structure that
+   contains it.  Refer to lib/kernel/list.h for a detailed
+   explanation of the technique. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* First child, the head of its list. */
+    struct heap_elem *next;     /* Next sibling. */
+    struct heap_elem *prev;     /* Previous sibling, or the parent for
+                                   a first child. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)                   \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child            \
+                     - offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Greatest element, or null. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+bool heap_empty (const struct heap *);
+struct heap_elem *heap_top (const struct heap *);
+void heap_insert (struct heap *, struct heap_elem *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_increase (struct heap *, struct heap_elem *);
+
+#endif /* lib/kernel/heap.h */
@@ -81,6 +81,12 @@ exec (const char *file)
   return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
 int
 wait (pid_t pid)
 {
@@ -153,6 +159,12 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+bool
+vmstat (struct vmstat *s)
+{
+  return syscall1 (SYS_VMSTAT, s);
+}
+
 bool
 chdir (const char *dir)
 {
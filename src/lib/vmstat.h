@@ -0,0 +1,27 @@
+#ifndef __LIB_VMSTAT_H
+#define __LIB_VMSTAT_H
+
+#include <stdint.h>
+
+/* Virtual memory statistics, as returned by the vmstat system
+   call.  Shared between the kernel and user programs. */
+struct vmstat
+  {
+    /* The calling process. */
+    unsigned long minor_faults;     /* Faults served without I/O. */
+    unsigned long major_faults;     /* Faults that read a file or swap. */
+    unsigned long pages_read;       /* Pages read from files or swap. */
+    uint64_t fault_cycles;          /* CPU cycles spent serving faults. */
+    unsigned long resident_pages;   /* Pages mapped into memory. */
+    unsigned long swapped_pages;    /* Pages in swap. */
+    unsigned long file_pages;       /* Pages backed by a file. */
+    unsigned long anon_pages;       /* Pages not backed by a file. */
+
+    /* The whole system. */
+    unsigned long frames;           /* Frames in the user pool. */
+    unsigned long frames_used;      /* Frames holding pages. */
+    unsigned long frames_peak;      /* Most frames ever used at once. */
+    unsigned long frames_shared;    /* Frames in the share cache. */
+  };
+
+#endif /* lib/vmstat.h */
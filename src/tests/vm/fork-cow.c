@@ -0,0 +1,39 @@
+/* Forks and checks that the child's writes to memory it shares
+   copy-on-write with the parent are not seen by the parent. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  child = fork ();
+  if (child == 0)
+    {
+      /* Child: overwrite our copy and make sure it took. */
+      memset (buf, 'c', SIZE);
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != 'c')
+          exit (1);
+      exit (81);
+    }
+
+  CHECK (child != PID_ERROR, "fork");
+  CHECK (wait (child) == 81, "wait for child (should return 81)");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i % 251))
+      fail ("byte %zu of parent's memory changed to %d", i, buf[i]);
+  msg ("parent's memory unchanged");
+}
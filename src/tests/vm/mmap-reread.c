@@ -0,0 +1,39 @@
+/* Maps a file and reads it, modifies one page through the
+   mapping, unmaps it, and then maps the file again to verify
+   that the modification was written back. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  static const char overwrite[] = "Now is the time for all good...";
+  char *actual = (char *) 0x10000000;
+  int handle;
+  mapid_t map;
+
+  /* Map the file and check its contents. */
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, actual)) != MAP_FAILED, "mmap \"sample.txt\"");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+
+  /* Dirty the page and unmap it. */
+  memcpy (actual, overwrite, strlen (overwrite));
+  msg ("munmap \"sample.txt\"");
+  munmap (map);
+
+  /* Map the file again and check that the change stuck. */
+  CHECK ((map = mmap (handle, actual)) != MAP_FAILED,
+         "mmap \"sample.txt\" again");
+  if (memcmp (actual, overwrite, strlen (overwrite))
+      || memcmp (actual + strlen (overwrite), sample + strlen (overwrite),
+                 strlen (sample) - strlen (overwrite)))
+    fail ("re-read of mmap'd file reported bad data");
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-reread) begin
+(mmap-reread) open "sample.txt"
+(mmap-reread) mmap "sample.txt"
+(mmap-reread) munmap "sample.txt"
+(mmap-reread) mmap "sample.txt" again
+(mmap-reread) end
+EOF
+pass;
@@ -0,0 +1,97 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point arithmetic, as used by the 4.4BSD
+   scheduler for recent_cpu and load_avg.  The kernel does not
+   support floating point, so real numbers are stored as an int
+   scaled by 2**14: 17 bits of integer part (plus sign) and 14
+   bits of fraction.
+
+   Products and quotients of two fixed-point values go through a
+   64-bit intermediate so that they do not overflow before being
+   scaled back down. */
+typedef int fixed_point_t;
+
+#define FP_SHIFT 14                     /* Number of fraction bits. */
+#define FP_ONE (1 << FP_SHIFT)          /* 1.0 in fixed point. */
+
+/* Returns integer N as a fixed-point value. */
+static inline fixed_point_t
+fp_int (int n)
+{
+  return n * FP_ONE;
+}
+
+/* Returns the fraction N / D as a fixed-point value. */
+static inline fixed_point_t
+fp_frac (int n, int d)
+{
+  return ((int64_t) n << FP_SHIFT) / d;
+}
+
+/* Returns X truncated toward zero to an integer. */
+static inline int
+fp_trunc (fixed_point_t x)
+{
+  return x / FP_ONE;
+}
+
+/* Returns X rounded to the nearest integer. */
+static inline int
+fp_round (fixed_point_t x)
+{
+  return x >= 0 ? (x + FP_ONE / 2) / FP_ONE : (x - FP_ONE / 2) / FP_ONE;
+}
+
+/* Returns X + Y. */
+static inline fixed_point_t
+fp_add (fixed_point_t x, fixed_point_t y)
+{
+  return x + y;
+}
+
+/* Returns X - Y. */
+static inline fixed_point_t
+fp_sub (fixed_point_t x, fixed_point_t y)
+{
+  return x - y;
+}
+
+/* Returns X + N, for integer N. */
+static inline fixed_point_t
+fp_add_int (fixed_point_t x, int n)
+{
+  return x + n * FP_ONE;
+}
+
+/* Returns X * Y. */
+static inline fixed_point_t
+fp_mul (fixed_point_t x, fixed_point_t y)
+{
+  return ((int64_t) x * y) >> FP_SHIFT;
+}
+
+/* Returns X / Y. */
+static inline fixed_point_t
+fp_div (fixed_point_t x, fixed_point_t y)
+{
+  return ((int64_t) x << FP_SHIFT) / y;
+}
+
+/* Returns X * N, for integer N. */
+static inline fixed_point_t
+fp_mul_int (fixed_point_t x, int n)
+{
+  return x * n;
+}
+
+/* Returns X / N, for integer N. */
+static inline fixed_point_t
+fp_div_int (fixed_point_t x, int n)
+{
+  return x / n;
+}
+
+#endif /* threads/fixed-point.h */
@@ -31,9 +31,16 @@
 #else
 #include "tests/threads/tests.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -52,6 +59,11 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -ramdisk: Size of the RAM disk to create, in kB, and physical
+   address of its memory, in kB, or 0 to use kernel pages. */
+static size_t ramdisk_kb;
+static size_t ramdisk_base_kb;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -68,6 +80,7 @@ static void usage (void);
 #ifdef FILESYS
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
+static void print_block_stats (char **argv);
 #endif
 
 int main (void) NO_RETURN;
@@ -98,6 +111,10 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+#ifdef VM
+  page_init ();
+  frame_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -123,9 +140,14 @@ main (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  virtio_blk_init ();
+  ramdisk_init (ramdisk_kb * 1024, ramdisk_base_kb * 1024);
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  swap_init ();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -150,16 +172,58 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* CPUID function 1 EDX bits. */
+#define CPUID_PSE 0x00000008    /* 4 MB pages supported. */
+#define CPUID_PGE 0x00002000    /* Global pages supported. */
+
+/* CR4 bits. */
+#define CR4_PSE 0x00000010      /* Enable 4 MB pages. */
+#define CR4_PGE 0x00000080      /* Enable global pages. */
+
+/* Returns the CPU's feature flags from CPUID function 1, EDX.
+   See [IA32-v2a] "CPUID". */
+static uint32_t
+cpu_features (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
+}
+
+/* Sets the bits in FLAGS in CR4.  See [IA32-v3a] 2.5 "Control
+   Registers". */
+static void
+cr4_set (uint32_t flags)
+{
+  uint32_t cr4;
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4 | flags) : "memory");
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports them, each 4 MB stretch of RAM that is
+   entirely present and holds no kernel text is mapped with a
+   single large page, which needs no page table and only one TLB
+   entry.  The kernel text stays in 4 kB pages so that it can
+   still be mapped read-only.
+
+   All of the kernel mapping is marked global, so that if the
+   CPU supports global pages, switching page directories keeps
+   the kernel's TLB entries. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  uint32_t features = cpu_features ();
+  bool pse = (features & CPUID_PSE) != 0;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -171,21 +235,39 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (pse && pte_idx == 0
+          && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr >= &_end_kernel_text || vaddr + PTSPAN <= &_start))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true);
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | PTE_G;
     }
 
+  /* Large pages must be enabled before they are used. */
+  if (pse)
+    cr4_set (CR4_PSE);
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Honor the global bits in the new page tables.  The loader's
+     page tables, which had none, are no longer in use. */
+  if (features & CPUID_PGE)
+    cr4_set (CR4_PGE);
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -251,14 +333,28 @@ parse_options (char **argv)
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
 #endif
+      else if (!strcmp (name, "-ramdisk"))
+        {
+          char *base = strchr (value, '@');
+          ramdisk_kb = atoi (value);
+          ramdisk_base_kb = base != NULL ? atoi (base + 1) : 0;
+        }
+      else if (!strcmp (name, "-bigdisks"))
+        ide_big_disks = true;
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-stack"))
+        stack_max = (size_t) atoi (value) * 1024 * 1024;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -315,6 +411,7 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"blkstats", 1, print_block_stats},
 #endif
       {NULL, 0, NULL},
     };
@@ -361,6 +458,7 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  blkstats           Print block device statistics.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -376,11 +474,18 @@ usage (void)
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
+          "  -ramdisk=SIZE[@BASE]  Create a SIZE kB RAM disk named ram0,\n"
+          "                     in kernel pages or at physical BASE kB.\n"
+          "  -bigdisks          Allow access to IDE disks over 1 GB.\n"
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the periodic timer tick while idle.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -stack=MB          Limit user stacks to MB MB (default 8).\n"
 #endif
           );
   shutdown_power_off ();
@@ -426,4 +531,12 @@ locate_block_device (enum block_type role, const char *name)
       block_set_role (role, block);
     }
 }
+
+/* Prints statistics for all block devices, for the "blkstats"
+   action. */
+static void
+print_block_stats (char **argv UNUSED)
+{
+  block_print_stats ();
+}
 #endif
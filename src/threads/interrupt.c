@@ -359,6 +359,10 @@ intr_handler (struct intr_frame *frame)
 
       in_external_intr = true;
       yield_on_return = false;
+
+      /* Catch up on ticks skipped by tickless idle first, so
+         that the handler sees the current time. */
+      timer_irq_enter ();
     }
 
   /* Invoke the interrupt's handler. */
@@ -23,7 +23,17 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool also keeps a few free pages zeroed in advance by the
+   idle thread, so that most single-page PAL_ZERO requests need
+   no memset.  Those pages are marked used in the bitmap, but are
+   handed out for any request if nothing else is free: a single
+   page directly, and multiple pages through a shrinker that
+   returns the zeroed pages to the bitmap. */
+
+/* Maximum number of pages zeroed in advance, per pool. */
+#define ZEROED_MAX 32
 
 /* A memory pool. */
 struct pool
@@ -31,14 +41,31 @@ struct pool
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    void *zeroed[ZEROED_MAX];           /* Free pages already zeroed. */
+    size_t zeroed_cnt;                  /* Number of pages in zeroed. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Registered shrinkers, and a lock that protects the list and
+   lets only one thread reclaim memory at a time. */
+static struct list shrinkers;
+static struct lock shrink_lock;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void *take_zeroed (struct pool *);
+static size_t release_zeroed (struct pool *);
+static bool shrink (enum palloc_flags, size_t page_cnt);
+
+static size_t shrink_zeroed (enum palloc_flags, size_t page_cnt);
+static struct shrinker zeroed_shrinker =
+  {
+    .name = "zeroed pages",
+    .shrink = shrink_zeroed,
+  };
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -59,13 +86,33 @@ palloc_init (size_t user_page_limit)
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+
+  list_init (&shrinkers);
+  lock_init (&shrink_lock);
+
+  /* Registered first, because giving back zeroed pages loses
+     nothing but the time spent zeroing them. */
+  palloc_register_shrinker (&zeroed_shrinker);
+}
+
+/* Adds S to the shrinkers that palloc calls on to free memory
+   when an allocation would otherwise fail. */
+void
+palloc_register_shrinker (struct shrinker *s)
+{
+  ASSERT (s->shrink != NULL);
+
+  lock_acquire (&shrink_lock);
+  list_push_back (&shrinkers, &s->elem);
+  lock_release (&shrink_lock);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
+   available even after asking the registered shrinkers to free
+   some, returns a null pointer, unless PAL_ASSERT is set in
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
@@ -77,14 +124,29 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  /* A single zeroed page is usually ready and waiting. */
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      lock_acquire (&pool->lock);
+      pages = take_zeroed (pool);
+      lock_release (&pool->lock);
+      if (pages != NULL)
+        return pages;
+    }
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  do
+    {
+      lock_acquire (&pool->lock);
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+      if (page_idx != BITMAP_ERROR)
+        pages = pool->base + PGSIZE * page_idx;
+      else if (page_cnt == 1)
+        pages = take_zeroed (pool);
+      else
+        pages = NULL;
+      lock_release (&pool->lock);
+    }
+  while (pages == NULL && shrink (flags, page_cnt));
 
   if (pages != NULL) 
     {
@@ -148,6 +210,89 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes a free page in advance, for a later PAL_ZERO request.
+   Returns true if successful, false if every pool already has
+   enough zeroed pages or has no free pages left.
+   Never sleeps, so that the idle thread can call it. */
+bool
+palloc_zero_ahead (void)
+{
+  struct pool *pools[] = {&kernel_pool, &user_pool};
+  size_t i;
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct pool *pool = pools[i];
+      size_t page_idx;
+      void *page;
+
+      if (!lock_try_acquire (&pool->lock))
+        continue;
+      page_idx = (pool->zeroed_cnt < ZEROED_MAX
+                  ? bitmap_scan_and_flip (pool->used_map, 0, 1, false)
+                  : BITMAP_ERROR);
+      if (page_idx != BITMAP_ERROR)
+        {
+          page = pool->base + PGSIZE * page_idx;
+          memset (page, 0, PGSIZE);
+          pool->zeroed[pool->zeroed_cnt++] = page;
+        }
+      lock_release (&pool->lock);
+      if (page_idx != BITMAP_ERROR)
+        return true;
+    }
+  return false;
+}
+
+/* Removes the PAGE_CNT pages starting at PAGES from the page
+   allocator, so that they will never be handed out, and returns
+   true.  The pages must all lie within a single pool.  Returns
+   false without reserving anything if they do not or if any of
+   them is already in use. */
+bool
+palloc_reserve (void *pages, size_t page_cnt)
+{
+  struct pool *pool;
+  size_t page_idx;
+  size_t i;
+  bool success = false;
+
+  ASSERT (pg_ofs (pages) == 0);
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    return false;
+
+  page_idx = pg_no (pages) - pg_no (pool->base);
+  lock_acquire (&pool->lock);
+
+  /* Pages zeroed in advance are really free. */
+  for (i = 0; i < pool->zeroed_cnt; )
+    {
+      size_t zeroed_idx = pg_no (pool->zeroed[i]) - pg_no (pool->base);
+      if (zeroed_idx >= page_idx && zeroed_idx < page_idx + page_cnt)
+        {
+          bitmap_reset (pool->used_map, zeroed_idx);
+          pool->zeroed[i] = pool->zeroed[--pool->zeroed_cnt];
+        }
+      else
+        i++;
+    }
+
+  if (page_idx + page_cnt <= bitmap_size (pool->used_map)
+      && bitmap_none (pool->used_map, page_idx, page_cnt))
+    {
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+      success = true;
+    }
+  lock_release (&pool->lock);
+
+  return success;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -165,10 +310,84 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
 
   /* Initialize the pool. */
   lock_init (&p->lock);
+  p->zeroed_cnt = 0;
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
 }
 
+/* Removes and returns a page from POOL's zeroed pages, or a null
+   pointer if there are none.  POOL's lock must be held. */
+static void *
+take_zeroed (struct pool *pool)
+{
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+  return pool->zeroed_cnt > 0 ? pool->zeroed[--pool->zeroed_cnt] : NULL;
+}
+
+/* Returns all of POOL's zeroed pages to its bitmap, so that they
+   can be part of a multi-page allocation, and returns how many
+   there were.  POOL's lock must be held. */
+static size_t
+release_zeroed (struct pool *pool)
+{
+  size_t cnt = pool->zeroed_cnt;
+
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+
+  while (pool->zeroed_cnt > 0)
+    {
+      void *page = pool->zeroed[--pool->zeroed_cnt];
+      bitmap_reset (pool->used_map, pg_no (page) - pg_no (pool->base));
+    }
+  return cnt;
+}
+
+/* Shrinker for the zeroed pages of the pool that FLAGS selects.
+   A single page is taken from the zeroed pages directly, so this
+   matters for multi-page requests, which need the pages back in
+   the bitmap. */
+static size_t
+shrink_zeroed (enum palloc_flags flags, size_t page_cnt UNUSED)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  size_t freed;
+
+  if (lock_held_by_current_thread (&pool->lock)
+      || !lock_try_acquire (&pool->lock))
+    return 0;
+  freed = release_zeroed (pool);
+  lock_release (&pool->lock);
+  return freed;
+}
+
+/* Asks the registered shrinkers to free PAGE_CNT pages from the
+   pool that FLAGS selects.  Returns true if they freed any, false
+   if they could not free anything.  Freed pages need not be
+   contiguous, so the caller should keep trying until this
+   returns false. */
+static bool
+shrink (enum palloc_flags flags, size_t page_cnt)
+{
+  struct list_elem *e;
+  size_t freed = 0;
+
+  /* A shrinker must not allocate memory, but if one does, don't
+     recurse. */
+  if (lock_held_by_current_thread (&shrink_lock))
+    return false;
+
+  lock_acquire (&shrink_lock);
+  for (e = list_begin (&shrinkers);
+       e != list_end (&shrinkers) && freed < page_cnt; e = list_next (e))
+    {
+      struct shrinker *s = list_entry (e, struct shrinker, elem);
+      freed += s->shrink (flags, page_cnt - freed);
+    }
+  lock_release (&shrink_lock);
+
+  return freed > 0;
+}
+
 /* Returns true if PAGE was allocated from POOL,
    false otherwise. */
 static bool
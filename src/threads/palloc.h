@@ -1,6 +1,8 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -11,10 +13,29 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
+/* A subsystem holding pages it can give back when memory runs
+   short, such as a cache.  When an allocation fails, palloc calls
+   each registered shrinker in turn and then tries again. */
+struct shrinker
+  {
+    struct list_elem elem;      /* Element in list of shrinkers. */
+    const char *name;           /* Name, for debugging. */
+
+    /* Frees up to PAGE_CNT pages, if possible, from the pool that
+       FLAGS selects (see palloc_get_multiple()), and returns the
+       number freed.  May be called with arbitrary locks held, so
+       it must only try to acquire locks, and must not allocate
+       memory. */
+    size_t (*shrink) (enum palloc_flags flags, size_t page_cnt);
+  };
+
 void palloc_init (size_t user_page_limit);
+void palloc_register_shrinker (struct shrinker *);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_reserve (void *, size_t page_cnt);
+bool palloc_zero_ahead (void);
 
 #endif /* threads/palloc.h */
@@ -77,25 +77,6 @@ sema_down (struct semaphore *sema)
   intr_set_level (old_level);
 }
 
-/* This variant of sema_down will insert elements into the semaphore's wait list in the order
-specified by tick_less_func */
-void
-sema_tick_ordered_down (struct semaphore *sema) 
-{
-  enum intr_level old_level;
-
-  ASSERT (sema != NULL);
-  ASSERT (!intr_context ());
-
-  old_level = intr_disable ();
-
-  list_insert_ordered (&sema->waiters, &thread_current ()->elem, *tick_less_func, NULL);
-  thread_block ();
-
-  sema->value--;
-  intr_set_level (old_level);
-}
-
 /* Down or "P" operation on a semaphore, but only if the
    semaphore is not already 0.  Returns true if the semaphore is
    decremented, false otherwise.
@@ -135,10 +116,16 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   sema->value++;
-  intr_set_level (old_level);
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      /* Donation may have changed priorities since the waiters
+         were queued, so look for the highest now. */
+      struct list_elem *e = list_min (&sema->waiters,
+                                      priority_less_func, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
+  intr_set_level (old_level);
 }
 
 static void sema_test_helper (void *sema_);
@@ -178,6 +165,8 @@ sema_test_helper (void *sema_)
     }
 }
 
+static void lock_taken (struct lock *);
+
 /* Initializes LOCK.  A lock can be held by at most a single
    thread at any given time.  Our locks are not "recursive", that
    is, it is an error for the thread currently holding a lock to
@@ -199,6 +188,7 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->priority = -1;
   sema_init (&lock->semaphore, 1);
 }
 
@@ -213,20 +203,38 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
-  
-  if (lock->holder != NULL){
-	if (lock->holder->priority < thread_current()->priority){
-		//lock_acquire(&(lock->holder)->priority_lock);
-		lock->holder->priority = thread_current()->priority;
-		//lock_release(&(lock->holder)->priority_lock);
-	}
- }
-	
+
+  old_level = intr_disable ();
+  if (lock->holder != NULL && !thread_mlfqs) 
+    {
+      /* Donate our priority to the holder, then on down the
+         chain of locks that each holder is itself waiting for.
+         A link whose lock already carries at least our priority
+         has passed it on already, and so has the rest of the
+         chain. */
+      struct lock *l;
+
+      cur->waiting_lock = lock;
+      for (l = lock; l != NULL && l->holder != NULL
+             && l->priority < cur->priority;
+           l = l->holder->waiting_lock) 
+        {
+          l->priority = cur->priority;
+          heap_increase (&l->holder->donors, &l->elem);
+          thread_update_priority (l->holder);
+        }
+    }
+
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->waiting_lock = NULL;
+  lock_taken (lock);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -238,14 +246,17 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    lock_taken (lock);
+  intr_set_level (old_level);
   return success;
 }
 
@@ -257,17 +268,57 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
-  lock->holder = NULL; 
-  //lock_acquire(&thread_current()->priority_lock);
+  /* Stop receiving the donations made through LOCK.  Those made
+     through other locks we hold still count. */
+  old_level = intr_disable ();
+  lock->holder = NULL;
+  if (!thread_mlfqs) 
+    {
+      heap_remove (&thread_current ()->donors, &lock->elem);
+      thread_update_priority (thread_current ());
+    }
+  sema_up (&lock->semaphore);
+  intr_set_level (old_level);
 
-  thread_current()->priority = thread_current()->base_priority;
-  //lock_release(&thread_current()->priority_lock);
+  thread_preempt ();
+}
 
-  
-  sema_up (&lock->semaphore);
+/* Makes the running thread, which has just acquired LOCK, its
+   holder.  Threads still waiting for LOCK keep donating through
+   it, now to the new holder.  Interrupts must be off. */
+static void
+lock_taken (struct lock *lock) 
+{
+  struct thread *cur = thread_current ();
+  struct list *waiters = &lock->semaphore.waiters;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = cur;
+  if (thread_mlfqs)
+    return;
+
+  lock->priority = -1;
+  if (!list_empty (waiters))
+    lock->priority = list_entry (list_min (waiters, priority_less_func, NULL),
+                                 struct thread, elem)->priority;
+  heap_insert (&cur->donors, &lock->elem);
+  thread_update_priority (cur);
+}
+
+/* Orders locks in a thread's `donors' heap by the priority
+   donated through them. */
+bool
+lock_priority_less (const struct heap_elem *a, const struct heap_elem *b,
+                    void *aux UNUSED) 
+{
+  return (heap_entry (a, struct lock, elem)->priority
+          < heap_entry (b, struct lock, elem)->priority);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -378,16 +429,6 @@ cond_broadcast (struct condition *cond, struct lock *lock)
     cond_signal (cond, lock);
 }
 
-
-bool tick_less_func(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED)
-{
-  struct thread *t1 = list_entry (a, struct thread, elem);
-  struct thread *t2 = list_entry (b, struct thread, elem);
-  long long p1 = t1->final_tick;
-  long long p2 = t2->final_tick;
-  return p1 < p2;
-}
-
 /* Used to sort condition variables based off of the priority of the contained thread */
 bool condvar_less_func(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED)
 {
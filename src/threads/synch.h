@@ -1,6 +1,7 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
 
@@ -22,6 +23,9 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    int priority;               /* Highest priority donated through this
+                                   lock, or -1 if none. */
+    struct heap_elem elem;      /* Element in holder's `donors' heap. */
   };
 
 void lock_init (struct lock *);
@@ -41,8 +45,8 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
-void sema_tick_ordered_down (struct semaphore *sema);
-bool tick_less_func(const struct list_elem *a, const struct list_elem *b, void *aux);
+bool lock_priority_less (const struct heap_elem *, const struct heap_elem *,
+                         void *aux);
 bool condvar_less_func(const struct list_elem *a, const struct list_elem *b, void *aux);
 
 /* Optimization barrier.
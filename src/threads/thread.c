@@ -11,6 +11,7 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -20,17 +21,19 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running.  There is one FIFO queue
+   per priority, and bit P of ready_mask is set if and only if
+   ready_queues[P] is nonempty, so the highest-priority ready
+   thread is found with a single bit scan however many threads
+   are runnable. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* List of threads that are waiting for a timer to go off */
-static struct semaphore sleep_timer_list;
-
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -64,6 +67,15 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler state.  ready_cnt counts
+   the threads in the run queues, so that the once-a-second
+   load_avg update does not have to walk them. */
+static fixed_point_t load_avg;  /* Estimated # of threads ready. */
+static int ready_cnt;           /* # of threads in ready_queues. */
+
+static void mlfqs_tick (struct thread *);
+static int mlfqs_priority (const struct thread *);
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -75,6 +87,10 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static void ready_requeue (struct thread *, int priority);
+static int highest_ready_priority (void);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -92,12 +108,17 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  ready_mask = 0;
+  ready_cnt = 0;
+  load_avg = fp_int (0);
   list_init (&all_list);
-  sema_init (&sleep_timer_list, 0);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -141,27 +162,77 @@ thread_tick (void)
   else
     kernel_ticks++;
 
-   /* Check if the thread soonest to wake up from a timed sleep is ready to wake up yet */
-   long long total_ticks = idle_ticks + user_ticks + kernel_ticks;
-   struct list_elem *first_elem = list_begin (&(sleep_timer_list.waiters));
-   struct thread *first_thread_to_wake = list_entry (first_elem, struct thread, elem);
-   if (!list_empty(&sleep_timer_list.waiters)){
-	  
-      while (first_thread_to_wake->final_tick <= total_ticks){
-         sema_up(&sleep_timer_list);
-		 intr_yield_on_return ();
-		 if(list_empty(&sleep_timer_list.waiters))
-			break;
-		 first_elem = list_begin (&(sleep_timer_list.waiters));
-		 first_thread_to_wake = list_entry (first_elem, struct thread, elem);
-      }
-   }
+  if (thread_mlfqs)
+    mlfqs_tick (t);
 
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
+/* Multi-level feedback queue accounting for a timer tick during
+   which T was running.
+
+   Only T's recent_cpu changes from tick to tick, so only T's
+   priority needs recomputing on the fourth tick; every other
+   thread's priority depends solely on values that change once a
+   second.  That keeps the per-tick cost constant, and the walk
+   over all threads happens just once per TIMER_FREQ ticks. */
+static void
+mlfqs_tick (struct thread *t) 
+{
+  int64_t ticks = timer_ticks ();
+
+  ASSERT (intr_context ());
+
+  if (t != idle_thread)
+    t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+
+  if (ticks % TIMER_FREQ == 0) 
+    {
+      struct list_elem *e;
+      fixed_point_t decay;
+      int ready_threads = ready_cnt + (t != idle_thread);
+
+      load_avg = fp_add (fp_mul (fp_frac (59, 60), load_avg),
+                         fp_mul_int (fp_frac (1, 60), ready_threads));
+
+      /* The decay factor is the same for every thread. */
+      decay = fp_div (fp_mul_int (load_avg, 2),
+                      fp_add_int (fp_mul_int (load_avg, 2), 1));
+      for (e = list_begin (&all_list); e != list_end (&all_list);
+           e = list_next (e)) 
+        {
+          struct thread *u = list_entry (e, struct thread, allelem);
+          if (u == idle_thread)
+            continue;
+          u->recent_cpu = fp_add_int (fp_mul (decay, u->recent_cpu),
+                                      u->nice);
+          ready_requeue (u, mlfqs_priority (u));
+        }
+    }
+  else if (ticks % 4 == 0 && t != idle_thread)
+    ready_requeue (t, mlfqs_priority (t));
+
+  if (ready_cnt > 0 && highest_ready_priority () > t->priority)
+    intr_yield_on_return ();
+}
+
+/* Returns the priority that T's recent_cpu and nice values
+   entitle it to. */
+static int
+mlfqs_priority (const struct thread *t) 
+{
+  int priority = PRI_MAX - fp_round (fp_div_int (t->recent_cpu, 4))
+                 - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  return priority;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
@@ -206,6 +277,12 @@ thread_create (const char *name, int priority,
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  if (thread_mlfqs) 
+    {
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+      t->priority = t->base_priority = mlfqs_priority (t);
+    }
 
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack' 
@@ -271,11 +348,12 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  //list_push_back
-  list_insert_ordered (&ready_list, &t->elem, *priority_less_func, NULL);
+  ready_push (t);
   t->status = THREAD_READY;
   if (t->priority > thread_current()->priority){ 
-	if (thread_current() != idle_thread){
+	if (intr_context ())
+	  intr_yield_on_return ();
+	else if (thread_current() != idle_thread){
 	  thread_yield();
 	}
   }
@@ -348,8 +426,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    //list_push_back (&ready_list, &cur->elem);
-	list_insert_ordered (&ready_list, &cur->elem, *priority_less_func, NULL);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -376,14 +453,58 @@ thread_foreach (thread_action_func *func, void *aux)
 void
 thread_set_priority (int new_priority) 
 {
-  lock_acquire(&thread_current()->priority_lock);
-  thread_current ()->priority = new_priority;
+  enum intr_level old_level;
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
   thread_current ()->base_priority = new_priority;
-  lock_release(&thread_current()->priority_lock);
-  if (thread_current ()->priority < list_entry (list_next(&thread_current()->elem), struct thread, elem) ->priority) {
-	list_sort(&ready_list, priority_less_func, NULL);
-	thread_yield();
-  }
+  thread_update_priority (thread_current ());
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Recomputes T's effective priority: the greater of its base
+   priority and the highest priority donated through any lock it
+   holds.  If T is ready to run, it is moved to the run queue for
+   its new priority.  Interrupts must be off. */
+void
+thread_update_priority (struct thread *t) 
+{
+  int priority = t->base_priority;
+
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs)
+    return;
+
+  if (!heap_empty (&t->donors)) 
+    {
+      struct lock *l = heap_entry (heap_top (&t->donors), struct lock, elem);
+      if (l->priority > priority)
+        priority = l->priority;
+    }
+  ready_requeue (t, priority);
+}
+
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread. */
+void
+thread_preempt (void) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (ready_mask != 0 && highest_ready_priority () > thread_get_priority ()) 
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else if (thread_current () != idle_thread)
+        thread_yield ();
+    }
+  intr_set_level (old_level);
 }
 
 /* Returns the current thread's priority. */
@@ -393,35 +514,52 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs) 
+    {
+      cur->priority = mlfqs_priority (cur);
+      if (ready_cnt > 0 && highest_ready_priority () > cur->priority)
+        thread_yield ();
+    }
+  intr_set_level (old_level);
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (fp_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent = fp_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -446,6 +584,17 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nobody else wants to run, so zero a free page for a later
+         PAL_ZERO allocation.  Interrupts are off only for the time
+         it takes to zero one page: turn them back on so that
+         pending interrupts can make a thread ready, then check
+         again. */
+      if (palloc_zero_ahead ()) 
+        {
+          intr_enable ();
+          continue;
+        }
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -457,7 +606,11 @@ idle (void *idle_started_ UNUSED)
          time.
 
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
+         7.11.1 "HLT Instruction".
+
+         In tickless mode, the timer is first set to interrupt
+         only when there is something for it to do. */
+      timer_idle ();
       asm volatile ("sti; hlt" : : : "memory");
     }
 }
@@ -504,16 +657,21 @@ init_thread (struct thread *t, const char *name, int priority)
   ASSERT (name != NULL);
 
   memset (t, 0, sizeof *t);
-  lock_init(&t->priority_lock);
-  list_init(&t->waiting_on_thread);
+  heap_init (&t->donors, lock_priority_less, NULL);
   t->final_tick = 0;
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
   t->base_priority = priority;
+  t->nice = NICE_DEFAULT;
+  t->recent_cpu = fp_int (0);
   t->magic = THREAD_MAGIC;
-  t->sleep_sema = &sleep_timer_list;
+#ifdef VM
+  list_init (&t->mappings);
+  list_init (&t->fds);
+  t->next_handle = 2;
+#endif
 
   list_insert_ordered (&all_list, &t->allelem, *priority_less_func, NULL);
   
@@ -540,10 +698,73 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  struct thread *t;
+
+  if (ready_mask == 0)
     return idle_thread;
+
+  t = list_entry (list_front (&ready_queues[highest_ready_priority ()]),
+                  struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
+/* Appends T to the back of the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_push (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes T from the run queue for its priority.  Interrupts
+   must be off. */
+static void
+ready_remove (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+/* Sets T's priority to PRIORITY, moving T to the matching run
+   queue if it is ready.  Interrupts must be off. */
+static void
+ready_requeue (struct thread *t, int priority) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY) 
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    t->priority = priority;
+}
+
+/* Returns the highest priority that has a ready thread.
+   ready_mask must be nonzero.  The mask is scanned as two 32-bit
+   halves so that each half is a single BSR instruction. */
+static int
+highest_ready_priority (void) 
+{
+  uint32_t hi = ready_mask >> 32;
+  uint32_t lo = ready_mask;
+
+  ASSERT (ready_mask != 0);
+
+  return hi != 0 ? 63 - __builtin_clz (hi) : 31 - __builtin_clz (lo);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -5,6 +5,7 @@
 #include <list.h>
 #include <stdint.h>
 #include <threads/synch.h>
+#include "threads/fixed-point.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -25,6 +26,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the multi-level feedback queue scheduler. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice to other threads. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -82,29 +88,54 @@ typedef int tid_t;
    semaphore wait list (synch.c).  It can be used these two ways
    only because they are mutually exclusive: only a thread in the
    ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   blocked state is on a semaphore wait list.  A sleeping thread
+   is likewise blocked, and uses `elem' for its timing wheel
+   bucket (devices/timer.c) instead. */
 struct thread
   {
-    long long final_tick;
+    long long final_tick;               /* Tick to wake up at, if
+                                           sleeping (devices/timer.c). */
     /* Owned by thread.c. */
     tid_t tid;                          /* Thread identifier. */
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     char * filename;
-	int donated_priorities[8];          /* array containing donated priorities */
     uint8_t *stack;                     /* Saved stack pointer. */
     int priority;                       /* Priority. */
 	int base_priority;                  /* Original priority. */
+    int nice;                           /* MLFQS niceness. */
+    fixed_point_t recent_cpu;           /* MLFQS recent CPU time. */
     struct list_elem allelem;           /* List element for all threads list. */
-	struct semaphore *sleep_sema;
-	struct lock priority_lock;
-	struct list waiting_on_thread;
+    struct heap donors;                 /* Locks held, by donated priority. */
+    struct lock *waiting_lock;          /* Lock being waited for, if any. */
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+#endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash *pages;                 /* Supplemental page table. */
+    struct file *exec_file;             /* Executable, for lazy loading. */
+    void *user_esp;                     /* User stack pointer, saved on
+                                           entry to the kernel. */
+    void *fault_next;                   /* Fault-around: where a fault
+                                           continues the last window. */
+    size_t fault_window;                /* Fault-around window, in pages. */
+    unsigned long minor_faults;         /* Faults served without I/O. */
+    unsigned long major_faults;         /* Faults that read file or swap. */
+    unsigned long pages_read;           /* Pages read from file or swap. */
+    uint64_t fault_cycles;              /* CPU cycles spent in faults. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Next mapping id. */
+
+    /* Owned by userprog/syscall.c. */
+    struct list fds;                    /* Open file descriptors. */
+    int next_handle;                    /* Next file descriptor. */
 #endif
     struct dir *cwd			/* Thread's current working directory */
     /* Owned by thread.c. */
@@ -141,6 +172,8 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_update_priority (struct thread *);
+void thread_preempt (void);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -15,8 +15,14 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "userprog/syscall.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
@@ -82,6 +88,81 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Passed from process_fork() to the child. */
+struct fork_info
+  {
+    struct thread *parent;      /* Forking process. */
+    struct intr_frame if_;      /* Parent's user context. */
+    struct semaphore done;      /* Upped once the child is set up. */
+    bool success;               /* Was the child set up successfully? */
+  };
+
+static thread_func start_fork NO_RETURN;
+
+/* Creates a copy of the current process that starts running in
+   user mode with the context in F, the frame of the system call
+   that called us, except that the system call returns 0 in the
+   child.  The child shares the parent's memory copy-on-write
+   (see page_fork()).  Returns the new process's thread id, or
+   TID_ERROR if it cannot be created. */
+tid_t
+process_fork (const struct intr_frame *f)
+{
+  struct fork_info info;
+  tid_t tid;
+
+  info.parent = thread_current ();
+  info.if_ = *f;
+  sema_init (&info.done, 0);
+  info.success = false;
+
+  tid = thread_create (info.parent->name, PRI_DEFAULT, start_fork, &info);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+  sema_down (&info.done);
+  return info.success ? tid : TID_ERROR;
+}
+
+/* A thread function that sets up a forked process's address
+   space and starts it running. */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+
+  /* The parent stays blocked until we are done with its page
+     table, so it cannot change underneath us. */
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    goto done;
+  process_activate ();
+  if (!page_table_init ())
+    goto done;
+  t->exec_file = file_reopen (info->parent->exec_file);
+  if (t->exec_file == NULL)
+    goto done;
+  file_deny_write (t->exec_file);
+  success = page_fork (info->parent);
+
+ done:
+  /* INFO is on the parent's stack, so it is gone once we let the
+     parent go. */
+  info->success = success;
+  sema_up (&info->done);
+  if (!success)
+    thread_exit ();
+
+  /* Return to user mode, as start_process() does. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -112,6 +193,18 @@ process_exit (void)
   pd = cur->pagedir;
   if (pd != NULL) 
     {
+#ifdef VM
+      /* Write modified pages of memory-mapped files back first. */
+      mmap_exit ();
+      syscall_close_files ();
+
+      /* Release the frames still mapped in PD, which are owned
+         by the supplemental page table rather than by PD.  This
+         unmaps them from PD, so it must happen while PD is
+         still our page directory. */
+      page_exit ();
+#endif
+
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
@@ -123,6 +216,10 @@ process_exit (void)
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
+#ifdef VM
+  file_close (cur->exec_file);
+  cur->exec_file = NULL;
+#endif
 }
 
 /* Sets up the CPU for running user code in the current
@@ -133,8 +230,14 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables.  A kernel thread has none of
+     its own and never touches user memory, so it just keeps
+     running on whichever page directory is loaded: the kernel
+     part of every page directory is the same.  That saves a pair
+     of TLB flushes when a process is interrupted by a kernel
+     thread and then resumes. */
+  if (t->pagedir != NULL)
+    pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -229,6 +332,10 @@ load (const char *file_name, void (**eip) (void), void **esp)
   if (t->pagedir == NULL) 
     goto done;
   process_activate ();
+#ifdef VM
+  if (!page_table_init ())
+    goto done;
+#endif
 
   /* Open executable file. */
   file = filesys_open (file_name);
@@ -237,6 +344,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
       printf ("load: %s: open failed\n", file_name);
       goto done; 
     }
+#ifdef VM
+  /* Pages are read from FILE on demand, so it must not change
+     while we are running. */
+  file_deny_write (file);
+#endif
 
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -321,13 +433,21 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
  done:
   /* We arrive here whether the load is successful or not. */
+#ifdef VM
+  /* Segments are loaded from FILE lazily, so keep it open until
+     the process exits. */
+  t->exec_file = file;
+#else
   file_close (file);
+#endif
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -386,6 +506,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only entered in the supplemental page
+   table here; they are read in when the process first touches
+   them.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -405,6 +529,20 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record where to find this page. */
+      struct page *p = page_allocate (upage, !writable);
+      if (p == NULL)
+        return false;
+      if (page_read_bytes > 0)
+        {
+          p->file = file;
+          p->file_offset = ofs;
+          p->file_bytes = page_read_bytes;
+        }
+      ofs += page_read_bytes;
+#else
+
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -424,6 +562,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -438,20 +577,27 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp, const char *file_name) 
 {
-  uint8_t *kpage;
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
   bool success = false;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+#ifdef VM
+  /* We are about to push the arguments, so fault the stack page
+     in right away. */
+  success = page_allocate (upage, false) != NULL && page_in (upage, true);
+#else
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL) 
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success) {
-        *esp = PHYS_BASE;
-		push_values_stack(esp, file_name);
-	  }
-      else
+      success = install_page (upage, kpage, true);
+      if (!success)
         palloc_free_page (kpage);
     }
+#endif
+  if (success)
+    {
+      *esp = PHYS_BASE;
+      push_values_stack (esp, file_name);
+    }
   return success;
 }
 
@@ -515,6 +661,7 @@ push_values_stack(void **esp, const char *file_name)
 	palloc_free_page (fname_copy); 
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -534,3 +681,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
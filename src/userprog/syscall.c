@@ -3,8 +3,39 @@
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "userprog/process.h"
+#ifdef VM
+#include <list.h>
+#include <string.h>
+#include <vmstat.h>
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static void syscall_handler (struct intr_frame *);
+#ifdef VM
+/* An open file. */
+struct file_descriptor
+  {
+    struct list_elem elem;      /* List element in thread's `fds'. */
+    int handle;                 /* File descriptor. */
+    struct file *file;          /* Open file. */
+  };
+
+static bool user_range_ok (const void *uaddr, size_t size, bool write);
+static void copy_in (void *dst, const void *usrc, size_t size);
+static void copy_out (void *udst, const void *src, size_t size);
+static char *copy_in_string (const char *us);
+static struct file_descriptor *lookup_fd (int handle);
+static int syscall_open (const char *ufile);
+static void syscall_close (int handle);
+static bool syscall_vmstat (struct vmstat *);
+#endif
 
 void
 syscall_init (void) 
@@ -15,8 +46,50 @@ syscall_init (void)
 static void
 syscall_handler (struct intr_frame *f UNUSED) 
 {
+#ifdef VM
+  const uint32_t *argv = f->esp;
+  int number;
+  uint32_t args[2];
+  struct file_descriptor *fd;
+
+  /* Kept for page faults on user memory while we handle the
+     call, for stack growth. */
+  thread_current ()->user_esp = f->esp;
+
+  /* The virtual memory calls, and opening and closing the files
+     that SYS_MMAP maps. */
+  copy_in (&number, argv, sizeof number);
+  switch (number)
+    {
+    case SYS_OPEN:
+      copy_in (args, argv + 1, sizeof *args);
+      f->eax = syscall_open ((const char *) args[0]);
+      return;
+    case SYS_CLOSE:
+      copy_in (args, argv + 1, sizeof *args);
+      syscall_close ((int) args[0]);
+      return;
+    case SYS_MMAP:
+      copy_in (args, argv + 1, sizeof args);
+      fd = lookup_fd ((int) args[0]);
+      f->eax = mmap_map (fd != NULL ? fd->file : NULL, (void *) args[1]);
+      return;
+    case SYS_MUNMAP:
+      copy_in (args, argv + 1, sizeof *args);
+      mmap_unmap ((mapid_t) args[0]);
+      return;
+    case SYS_FORK:
+      f->eax = process_fork (f);
+      return;
+    case SYS_VMSTAT:
+      copy_in (args, argv + 1, sizeof *args);
+      f->eax = syscall_vmstat ((struct vmstat *) args[0]);
+      return;
+    }
+#endif
+
   printf ("system call!\n");
-  
+
   case SYS_CHDIR: 
     if (!is_valid_pointer(ARG1)){
   		syscall_exit(-1);
@@ -51,6 +124,169 @@ syscall_handler (struct intr_frame *f UNUSED)
   thread_exit ();
 }
 
+#ifdef VM
+/* Returns true if the current process may access the SIZE bytes
+   at user address UADDR, writing them if WRITE.  Every page in
+   the range must belong to the process (or be within reach of
+   its stack), so that any page fault the kernel takes on the
+   range will be resolved rather than be fatal. */
+static bool
+user_range_ok (const void *uaddr, size_t size, bool write)
+{
+  const uint8_t *start = uaddr;
+  const uint8_t *page;
+
+  if (size == 0)
+    return true;
+  if (!is_user_vaddr (start)
+      || size > (size_t) ((uint8_t *) PHYS_BASE - start))
+    return false;
+
+  for (page = pg_round_down (start); page < start + size; page += PGSIZE)
+    if (!page_accessible (page, write))
+      return false;
+  return true;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Terminates the process if any of USRC is not readable. */
+static void
+copy_in (void *dst, const void *usrc, size_t size)
+{
+  if (!user_range_ok (usrc, size, false))
+    thread_exit ();
+  memcpy (dst, usrc, size);
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Terminates the process if any of UDST is not
+   writable. */
+static void
+copy_out (void *udst, const void *src, size_t size)
+{
+  if (!user_range_ok (udst, size, true))
+    thread_exit ();
+  memcpy (udst, src, size);
+}
+
+/* Copies the null-terminated string at user address US into a
+   new page and returns it; the caller must free it with
+   palloc_free_page().  A string too long for the page is
+   truncated.  Terminates the process if any of US is not
+   readable or if memory allocation fails. */
+static char *
+copy_in_string (const char *us)
+{
+  char *ks;
+  size_t length;
+
+  ks = palloc_get_page (0);
+  if (ks == NULL)
+    thread_exit ();
+
+  for (length = 0; length < PGSIZE; length++)
+    {
+      if (!user_range_ok (us + length, 1, false))
+        {
+          palloc_free_page (ks);
+          thread_exit ();
+        }
+      ks[length] = us[length];
+      if (ks[length] == '\0')
+        return ks;
+    }
+  ks[PGSIZE - 1] = '\0';
+  return ks;
+}
+
+/* Returns the current process's file descriptor HANDLE, or a
+   null pointer if it has no such descriptor. */
+static struct file_descriptor *
+lookup_fd (int handle)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->fds); e != list_end (&t->fds);
+       e = list_next (e))
+    {
+      struct file_descriptor *fd
+        = list_entry (e, struct file_descriptor, elem);
+      if (fd->handle == handle)
+        return fd;
+    }
+  return NULL;
+}
+
+/* Open system call: opens the file named UFILE and returns a
+   new file descriptor for it, or -1 if the file cannot be
+   opened. */
+static int
+syscall_open (const char *ufile)
+{
+  struct thread *t = thread_current ();
+  char *kfile = copy_in_string (ufile);
+  struct file_descriptor *fd;
+  int handle = -1;
+
+  fd = malloc (sizeof *fd);
+  if (fd != NULL)
+    {
+      fd->file = filesys_open (kfile);
+      if (fd->file != NULL)
+        {
+          fd->handle = handle = t->next_handle++;
+          list_push_back (&t->fds, &fd->elem);
+        }
+      else
+        free (fd);
+    }
+  palloc_free_page (kfile);
+  return handle;
+}
+
+/* Close system call: closes file descriptor HANDLE.  A handle
+   that is not open is ignored. */
+static void
+syscall_close (int handle)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+
+  if (fd != NULL)
+    {
+      list_remove (&fd->elem);
+      file_close (fd->file);
+      free (fd);
+    }
+}
+
+/* Closes all of the current process's file descriptors. */
+void
+syscall_close_files (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->fds))
+    {
+      struct file_descriptor *fd
+        = list_entry (list_front (&t->fds), struct file_descriptor, elem);
+      syscall_close (fd->handle);
+    }
+}
+
+/* Vmstat system call: stores the current process's paging
+   statistics and the state of the frame table in *S. */
+static bool
+syscall_vmstat (struct vmstat *s)
+{
+  struct vmstat stats;
+
+  page_get_stats (&stats);
+  copy_out (s, &stats, sizeof stats);
+  return true;
+}
+#endif
+
 bool
 syscall_chdir (const char *dir)
 {
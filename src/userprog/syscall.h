@@ -2,5 +2,8 @@
 #define USERPROG_SYSCALL_H
 
 void syscall_init (void);
+#ifdef VM
+void syscall_close_files (void);
+#endif
 
 #endif /* userprog/syscall.h */
@@ -0,0 +1,497 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include <vmstat.h>
+#include "vm/page.h"
+#include "vm/swap.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+
+/* A page of zeros. */
+void *zero_page;
+
+/* Every page in the user pool, as a frame. */
+static struct frame *frames;
+static size_t frame_cnt;
+
+/* Protects the free frame list and the clock hand.
+   A thread holding a frame's lock may acquire scan_lock, but not
+   the other way around: with scan_lock held, the locks of frames
+   in use are only taken with lock_try_acquire(). */
+static struct lock scan_lock;
+static struct list free_frames;   /* Frames with no pages. */
+static size_t hand;               /* Next frame for clock to examine. */
+static size_t free_cnt;           /* Number of frames in free_frames. */
+static size_t peak_used;          /* Most frames ever in use at once. */
+
+/* Share cache: frames holding file data that may be mapped by
+   more than one process, keyed by inode, offset, and length.
+   share_lock protects the cache and the share cache members of
+   every frame.  As with scan_lock, a thread holding a frame's
+   lock may acquire share_lock, but a thread holding share_lock
+   may only try to acquire a frame's lock. */
+static struct hash share_cache;
+static struct lock share_lock;
+
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+
+/* Takes every page in the user pool and turns it into a frame.
+   From here on, user pages are allocated only through the frame
+   table. */
+void
+frame_init (void)
+{
+  void *pages = NULL;
+  void *base;
+  size_t i;
+
+  lock_init (&scan_lock);
+  list_init (&free_frames);
+  lock_init (&share_lock);
+  if (!hash_init (&share_cache, share_hash, share_less, NULL))
+    PANIC ("out of memory allocating share cache");
+  zero_page = palloc_get_page (PAL_ZERO);
+  if (zero_page == NULL)
+    PANIC ("out of memory allocating zero page");
+
+  /* Count the pages, chaining them together through their first
+     words as we go. */
+  while ((base = palloc_get_page (PAL_USER)) != NULL)
+    {
+      *(void **) base = pages;
+      pages = base;
+      frame_cnt++;
+    }
+
+  frames = malloc (sizeof *frames * frame_cnt);
+  if (frames == NULL && frame_cnt > 0)
+    PANIC ("out of memory allocating page frames");
+
+  for (i = 0, base = pages; base != NULL; i++, base = *(void **) base)
+    {
+      struct frame *f = &frames[i];
+      lock_init (&f->lock);
+      f->base = base;
+      list_init (&f->pages);
+      f->cached = false;
+      f->inode = NULL;
+      list_push_back (&free_frames, &f->free_elem);
+    }
+  free_cnt = frame_cnt;
+}
+
+/* Advances the clock hand past one frame.  If that frame is not
+   locked, holds pages that can be evicted, and has not been
+   accessed since the hand last passed it, returns the frame,
+   locked.
+   Otherwise, returns a null pointer.  Either way, the pages lose
+   their "second chance": their accessed bits are cleared.
+   Must be called with scan_lock held. */
+static struct frame *
+clock_advance (void)
+{
+  struct frame *f = &frames[hand];
+  if (++hand >= frame_cnt)
+    hand = 0;
+
+  /* A frame we hold ourselves is in use by our own fault, as
+     when copy-on-write allocates the copy with the shared frame
+     still locked; lock_try_acquire() would assert on it. */
+  if (lock_held_by_current_thread (&f->lock)
+      || !lock_try_acquire (&f->lock))
+    return NULL;
+
+  if (!list_empty (&f->pages)
+      && !page_accessed_recently (f)
+      && page_evictable (f))
+    return f;
+
+  lock_release (&f->lock);
+  return NULL;
+}
+
+/* Chooses a frame to evict using the "second chance" clock
+   algorithm: sweeps through the frames in order, skipping pinned
+   frames and pages that can't be evicted, and clearing the
+   accessed bits of recently used pages instead of evicting
+   them.  Returns the victim, locked, or a null pointer if two
+   full sweeps find nothing to evict.
+   Must be called with scan_lock held. */
+static struct frame *
+choose_victim (void)
+{
+  size_t i;
+
+  for (i = 0; i < frame_cnt * 2; i++)
+    {
+      struct frame *f = clock_advance ();
+      if (f != NULL)
+        return f;
+    }
+
+  return NULL;
+}
+
+/* VICTIMS[0] is a locked victim that must be written to swap.
+   Continues the clock sweep a short way to find more such
+   victims to write to swap along with it, adding them, locked,
+   to VICTIMS.  Candidates that don't need swap are left for
+   later sweeps, since evicting them costs no I/O.  Returns the
+   total number of victims, at most SWAP_CLUSTER.
+   Must be called with scan_lock held. */
+static size_t
+choose_cluster (struct frame *victims[SWAP_CLUSTER])
+{
+  size_t cnt = 1;
+  size_t i;
+
+  /* Stop before the hand comes back around to VICTIMS[0]. */
+  for (i = 0; i < 2 * SWAP_CLUSTER && i + 1 < frame_cnt; i++)
+    {
+      struct frame *f;
+
+      if (cnt >= SWAP_CLUSTER)
+        break;
+      f = clock_advance ();
+      if (f == NULL)
+        continue;
+      if (page_needs_swap (f))
+        victims[cnt++] = f;
+      else
+        lock_release (&f->lock);
+    }
+
+  return cnt;
+}
+
+/* Evicts a frame's pages to make room for PAGE.  Returns the
+   frame, locked and holding PAGE, or a null pointer if nothing
+   could be evicted.
+   Must be called with scan_lock held, which it releases before
+   writing anything out, so as not to hold up the rest of the
+   frame table. */
+static struct frame *
+evict (struct page *page)
+{
+  struct frame *victims[SWAP_CLUSTER];
+  struct frame *f;
+  size_t cnt, i;
+
+  f = victims[0] = choose_victim ();
+  if (f == NULL)
+    {
+      lock_release (&scan_lock);
+      return NULL;
+    }
+
+  /* A request to the swap device costs nearly as much for a few
+     pages as for one, so if the victim has to go to swap, send
+     some company along with it. */
+  cnt = page_needs_swap (f) ? choose_cluster (victims) : 1;
+  lock_release (&scan_lock);
+
+  if (cnt > 1)
+    {
+      if (page_out_cluster (victims, cnt))
+        {
+          /* Keep the first frame for PAGE.  The rest are free for
+             the faults to come. */
+          for (i = 1; i < cnt; i++)
+            frame_free (victims[i]);
+          goto done;
+        }
+
+      /* Swap has no room for the whole cluster, so fall back to
+         evicting the first victim alone. */
+      for (i = 1; i < cnt; i++)
+        lock_release (&victims[i]->lock);
+    }
+
+  if (!page_out (f))
+    {
+      lock_release (&f->lock);
+      return NULL;
+    }
+
+ done:
+  frame_unshare (f);
+  list_push_back (&f->pages, &page->frame_elem);
+  return f;
+}
+
+/* Tries to allocate and lock a frame for PAGE, evicting other
+   pages if no frame is free.  Returns the frame if successful,
+   a null pointer on failure. */
+static struct frame *
+try_frame_alloc_and_lock (struct page *page)
+{
+  struct frame *f;
+
+  lock_acquire (&scan_lock);
+
+  /* Use a free frame if there is one. */
+  if (!list_empty (&free_frames))
+    {
+      f = list_entry (list_pop_front (&free_frames),
+                      struct frame, free_elem);
+      free_cnt--;
+      if (frame_cnt - free_cnt > peak_used)
+        peak_used = frame_cnt - free_cnt;
+      lock_acquire (&f->lock);
+      list_push_back (&f->pages, &page->frame_elem);
+      lock_release (&scan_lock);
+      return f;
+    }
+
+  /* Otherwise evict a page. */
+  return evict (page);
+}
+
+/* Returns true if a frame is free, so that allocating one now
+   would not evict anything.  The answer may be out of date by
+   the time the caller acts on it. */
+bool
+frame_available (void)
+{
+  bool available;
+
+  lock_acquire (&scan_lock);
+  available = !list_empty (&free_frames);
+  lock_release (&scan_lock);
+  return available;
+}
+
+/* Tries really hard to allocate and lock a frame for PAGE, which
+   must not be in any frame.  The frame is PAGE's alone.
+   Returns the frame if successful, a null pointer on failure. */
+struct frame *
+frame_alloc_and_lock (struct page *page)
+{
+  size_t try;
+
+  for (try = 0; try < 3; try++)
+    {
+      struct frame *f = try_frame_alloc_and_lock (page);
+      if (f != NULL)
+        {
+          ASSERT (lock_held_by_current_thread (&f->lock));
+          return f;
+        }
+    }
+
+  return NULL;
+}
+
+/* Initializes F's share cache key for PAGE's file data. */
+static void
+set_share_key (struct frame *f, struct page *page)
+{
+  f->inode = file_get_inode (page->file);
+  f->offset = page->file_offset;
+  f->bytes = page->file_bytes;
+}
+
+/* Returns true if F is in the share cache under KEY's key. */
+static bool
+has_share_key (struct frame *f, struct frame *key)
+{
+  bool same;
+
+  lock_acquire (&share_lock);
+  same = (f->cached && f->inode == key->inode
+          && f->offset == key->offset && f->bytes == key->bytes);
+  lock_release (&share_lock);
+  return same;
+}
+
+/* Finds or allocates a frame in the share cache for PAGE's file
+   data, which must be mapped read-only, adds PAGE to it, and
+   locks it.  If the frame is newly allocated, sets *FRESH to
+   true, and the caller must read in the data before unlocking
+   the frame; otherwise, sets *FRESH to false.
+   Returns the frame if successful, a null pointer on failure. */
+struct frame *
+frame_share_and_lock (struct page *page, bool *fresh)
+{
+  struct frame key, *f;
+  struct hash_elem *e;
+
+  ASSERT (page->file != NULL);
+  set_share_key (&key, page);
+
+  for (;;)
+    {
+      lock_acquire (&share_lock);
+      e = hash_find (&share_cache, &key.share_elem);
+      if (e == NULL)
+        break;
+      f = hash_entry (e, struct frame, share_elem);
+      if (lock_try_acquire (&f->lock))
+        {
+          lock_release (&share_lock);
+          goto found;
+        }
+      lock_release (&share_lock);
+
+      /* Someone is reading the data in, or evicting it.  Wait,
+         then check that it is still what we want. */
+      lock_acquire (&f->lock);
+      if (has_share_key (f, &key))
+        goto found;
+      lock_release (&f->lock);
+    }
+  lock_release (&share_lock);
+
+  /* Not cached.  Allocate a frame and add it to the cache while
+     it is still locked, so that anyone else who wants the same
+     data waits for us to read it in.  If someone else got there
+     first, our frame just stays out of the cache. */
+  f = frame_alloc_and_lock (page);
+  if (f == NULL)
+    return NULL;
+  lock_acquire (&share_lock);
+  set_share_key (f, page);
+  f->cached = hash_insert (&share_cache, &f->share_elem) == NULL;
+  lock_release (&share_lock);
+  *fresh = true;
+  return f;
+
+ found:
+  list_push_back (&f->pages, &page->frame_elem);
+  *fresh = false;
+  return f;
+}
+
+/* Locks P's frame into memory, if it has one.
+   Upon return, p->frame will not change until P is unlocked. */
+void
+frame_lock (struct page *p)
+{
+  /* A frame can be asynchronously removed, but never inserted. */
+  struct frame *f = p->frame;
+  if (f != NULL)
+    {
+      lock_acquire (&f->lock);
+      if (f != p->frame)
+        {
+          lock_release (&f->lock);
+          ASSERT (p->frame == NULL);
+        }
+    }
+}
+
+/* Removes F from the share cache, if it is there, so that no
+   more pages will be added to it.  F must be locked. */
+void
+frame_unshare (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  lock_acquire (&share_lock);
+  if (f->cached)
+    {
+      hash_delete (&share_cache, &f->share_elem);
+      f->cached = false;
+    }
+  lock_release (&share_lock);
+}
+
+/* Removes the frame caching PAGE's file data, if any, from the
+   share cache, because the file data has changed.  Processes
+   already sharing the frame keep using it, since Pintos makes no
+   promise that processes see each other's changes to a file
+   until they map it again. */
+void
+frame_share_invalidate (struct page *page)
+{
+  struct frame key;
+  struct hash_elem *e;
+
+  set_share_key (&key, page);
+  lock_acquire (&share_lock);
+  e = hash_delete (&share_cache, &key.share_elem);
+  if (e != NULL)
+    hash_entry (e, struct frame, share_elem)->cached = false;
+  lock_release (&share_lock);
+}
+
+/* Releases frame F for use by other pages.
+   F must be locked for use by the current process and must no
+   longer hold any pages.  Any data in F is lost. */
+void
+frame_free (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (list_empty (&f->pages));
+
+  frame_unshare (f);
+  lock_acquire (&scan_lock);
+  list_push_back (&free_frames, &f->free_elem);
+  free_cnt++;
+  lock_release (&scan_lock);
+  lock_release (&f->lock);
+}
+
+/* Unlocks frame F, allowing it to be evicted.
+   F must be locked for use by the current process. */
+void
+frame_unlock (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  lock_release (&f->lock);
+}
+
+/* Fills in the whole-system members of *S. */
+void
+frame_get_stats (struct vmstat *s)
+{
+  lock_acquire (&scan_lock);
+  s->frames = frame_cnt;
+  s->frames_used = frame_cnt - free_cnt;
+  s->frames_peak = peak_used;
+  lock_release (&scan_lock);
+
+  lock_acquire (&share_lock);
+  s->frames_shared = hash_size (&share_cache);
+  lock_release (&share_lock);
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  struct vmstat s;
+
+  frame_get_stats (&s);
+  printf ("Frames: %lu of %lu in use (peak %lu), %lu in share cache\n",
+          s.frames_used, s.frames, s.frames_peak, s.frames_shared);
+}
+
+/* Returns a hash value for the share cache key of the frame that
+   E refers to. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, share_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->offset);
+}
+
+/* Returns true if the share cache key of frame A precedes that
+   of frame B. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, share_elem);
+  const struct frame *b = hash_entry (b_, struct frame, share_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  else if (a->offset != b->offset)
+    return a->offset < b->offset;
+  else
+    return a->bytes < b->bytes;
+}
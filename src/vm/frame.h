@@ -0,0 +1,62 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct page;
+
+/* A physical frame in the user pool.
+
+   A frame is "pinned" while its lock is held: the eviction
+   clock skips it, and the pages it holds stay where they are.
+   The page fault handler pins a frame while it fills it, and a
+   frame's pages are only ever changed with the frame pinned.
+
+   Usually a frame holds a single page, but a frame whose data
+   comes straight from a file may be in the "share cache", which
+   lets every process that maps the same part of the same file,
+   or runs the same executable, map the same frame.  Such frames
+   are mapped read-only; a process that writes one gets a private
+   copy. */
+struct frame
+  {
+    struct lock lock;           /* Pin; prevents simultaneous access. */
+    void *base;                 /* Kernel virtual base address. */
+    struct list pages;          /* Pages in this frame (each with owner
+                                   and user address); empty if free. */
+    struct list_elem free_elem; /* Element in free frame list. */
+
+    /* Share cache.  Protected by share_lock in frame.c. */
+    bool cached;                /* In the share cache? */
+    struct inode *inode;        /* Contents are from this inode... */
+    off_t offset;               /* ...at this offset... */
+    off_t bytes;                /* ...this many bytes, then zeros. */
+    struct hash_elem share_elem; /* Share cache element. */
+  };
+
+/* A page of zeros, outside the frame table.  Pages that are to
+   start out zeroed map it read-only until they are written. */
+extern void *zero_page;
+
+void frame_init (void);
+
+bool frame_available (void);
+struct frame *frame_alloc_and_lock (struct page *);
+struct frame *frame_share_and_lock (struct page *, bool *fresh);
+void frame_lock (struct page *);
+
+void frame_unshare (struct frame *);
+void frame_share_invalidate (struct page *);
+
+void frame_free (struct frame *);
+void frame_unlock (struct frame *);
+
+struct vmstat;
+void frame_get_stats (struct vmstat *);
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,125 @@
+#include "vm/mmap.h"
+#include <round.h>
+#include <stdint.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* Unmaps the first PAGE_CNT pages of mapping M, writing back any
+   that were modified. */
+static void
+unmap_pages (struct mapping *m, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    page_deallocate (m->base + i * PGSIZE);
+}
+
+/* Maps FILE, which must be open, into the current process's
+   address space starting at ADDR.  The pages are not read until
+   the process touches them.
+   Returns the new mapping's id, or MAP_FAILED if FILE is empty,
+   if ADDR is null or not page-aligned, if the mapping would
+   overlap pages already in use or extend past user memory, or if
+   memory allocation fails. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+  size_t i;
+
+  if (file == NULL || addr == NULL || pg_ofs (addr) != 0
+      || !is_user_vaddr (addr))
+    return MAP_FAILED;
+
+  /* ADDR is below PHYS_BASE, so the room left above it cannot
+     wrap around, and since both are page-aligned, a LENGTH that
+     fits also fits once rounded up to whole pages. */
+  length = file_length (file);
+  if (length <= 0
+      || (size_t) length > (uintptr_t) PHYS_BASE - (uintptr_t) addr)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+  m->base = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      struct page *p = page_allocate (m->base + ofs, false);
+      if (p == NULL)
+        {
+          unmap_pages (m, i);
+          file_close (m->file);
+          free (m);
+          return MAP_FAILED;
+        }
+      p->private = false;
+      p->file = m->file;
+      p->file_offset = ofs;
+      p->file_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+    }
+
+  m->handle = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->handle;
+}
+
+/* Removes mapping M from the current process, writing its
+   modified pages back to the file, and frees it. */
+static void
+unmap (struct mapping *m)
+{
+  list_remove (&m->elem);
+  unmap_pages (m, m->page_cnt);
+  file_close (m->file);
+  free (m);
+}
+
+/* Removes the current process's mapping with id HANDLE.
+   Returns true if successful, false if there is no such
+   mapping. */
+bool
+mmap_unmap (mapid_t handle)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->handle == handle)
+        {
+          unmap (m);
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Removes all of the current process's mappings.  Must be
+   called before page_exit(), so that modified pages are written
+   back to their files. */
+void
+mmap_exit (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_front (&t->mappings), struct mapping, elem));
+}
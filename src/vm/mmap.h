@@ -0,0 +1,34 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct file;
+
+/* Map region identifier. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t) -1)
+
+/* A memory-mapped file.
+
+   Each page of the mapping is an ordinary page in the process's
+   supplemental page table, loaded lazily from the file and
+   written back to it, rather than to swap, when it is evicted or
+   unmapped. */
+struct mapping
+  {
+    struct list_elem elem;      /* List element in thread's `mappings'. */
+    mapid_t handle;             /* Mapping id. */
+    struct file *file;          /* File, reopened for the mapping. */
+    uint8_t *base;              /* Start of memory mapping. */
+    size_t page_cnt;            /* Number of pages mapped. */
+  };
+
+mapid_t mmap_map (struct file *, void *addr);
+bool mmap_unmap (mapid_t);
+void mmap_exit (void);
+
+#endif /* vm/mmap.h */
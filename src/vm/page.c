@@ -0,0 +1,824 @@
+#include "vm/page.h"
+#include <stdio.h>
+#include <string.h>
+#include <vmstat.h>
+#include "devices/tsc.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Maximum size of a process's stack, in bytes. */
+size_t stack_max = 8 * 1024 * 1024;
+
+/* Maximum number of pages read in beyond a page faulted in from
+   a file. */
+#define FAULT_AROUND_MAX 16
+
+/* Fault statistics of processes that have exited. */
+static struct lock stats_lock;
+static unsigned long long minor_total, major_total, read_total;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+
+/* Initializes the paging statistics. */
+void
+page_init (void)
+{
+  lock_init (&stats_lock);
+}
+
+/* Creates an empty supplemental page table for the current
+   process.  Returns true if successful, false on failure. */
+bool
+page_table_init (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->pages == NULL);
+  t->pages = malloc (sizeof *t->pages);
+  if (t->pages == NULL)
+    return false;
+  if (!hash_init (t->pages, page_hash, page_less, NULL))
+    {
+      free (t->pages);
+      t->pages = NULL;
+      return false;
+    }
+  return true;
+}
+
+/* Returns true if page P, which must have a frame, may be mapped
+   writable: it must be writable and alone in a frame that is
+   not in the share cache. */
+static bool
+page_writable (struct page *p)
+{
+  struct frame *f = p->frame;
+
+  return (!p->read_only && !f->cached
+          && list_begin (&f->pages) == list_rbegin (&f->pages));
+}
+
+/* Writes page P, which must have a locked frame, back to its
+   file.  Returns true if successful, false on failure. */
+static bool
+write_back (struct page *p)
+{
+  bool ok = (file_write_at (p->file, p->frame->base, p->file_bytes,
+                            p->file_offset) == p->file_bytes);
+  frame_share_invalidate (p);
+  return ok;
+}
+
+/* Takes page P out of its frame, which must be locked.  If P was
+   dirty, the frame's other pages, if any, inherit its dirty bit,
+   since the frame still holds data found nowhere else. */
+static void
+leave_frame (struct page *p)
+{
+  struct frame *f = p->frame;
+
+  list_remove (&p->frame_elem);
+  p->frame = NULL;
+  if (pagedir_is_dirty (p->thread->pagedir, p->addr)
+      && !list_empty (&f->pages))
+    {
+      struct page *q = list_entry (list_front (&f->pages),
+                                   struct page, frame_elem);
+      pagedir_set_dirty (q->thread->pagedir, q->addr, true);
+    }
+}
+
+/* Takes page P, which must have a locked frame, out of its frame,
+   first writing it back to its file if it is a modified page of
+   a memory-mapped file.  Frees the frame if no other page is in
+   it, otherwise unlocks it. */
+static void
+release_frame (struct page *p)
+{
+  struct frame *f = p->frame;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  if (!p->private && pagedir_is_dirty (p->thread->pagedir, p->addr))
+    write_back (p);
+  pagedir_clear_page (p->thread->pagedir, p->addr);
+  leave_frame (p);
+
+  if (list_empty (&f->pages))
+    frame_free (f);
+  else
+    frame_unlock (f);
+}
+
+/* Destroys page P, which must belong to the current process.
+   Releases its frame or swap slot, if it has one. */
+static void
+destroy_page (struct hash_elem *p_, void *aux UNUSED)
+{
+  struct page *p = hash_entry (p_, struct page, hash_elem);
+
+  frame_lock (p);
+  if (p->frame != NULL)
+    release_frame (p);
+  else
+    {
+      /* The page may still map the zero page. */
+      pagedir_clear_page (p->thread->pagedir, p->addr);
+      if (p->sector != (block_sector_t) -1)
+        swap_free (p);
+    }
+  free (p);
+}
+
+/* Destroys the current process's supplemental page table,
+   freeing every frame it refers to.  Must be called before the
+   process's page directory is destroyed, because
+   pagedir_destroy() would otherwise free the frames too. */
+void
+page_exit (void)
+{
+  struct thread *t = thread_current ();
+
+  lock_acquire (&stats_lock);
+  minor_total += t->minor_faults;
+  major_total += t->major_faults;
+  read_total += t->pages_read;
+  lock_release (&stats_lock);
+
+  if (t->pages != NULL)
+    {
+      hash_destroy (t->pages, destroy_page);
+      free (t->pages);
+      t->pages = NULL;
+    }
+}
+
+/* Returns the page containing the given virtual ADDRESS in the
+   current process's supplemental page table, or a null pointer
+   if there is no such page. */
+static struct page *
+page_for_addr (const void *address)
+{
+  struct thread *t = thread_current ();
+  struct page p;
+  struct hash_elem *e;
+
+  if (t->pages == NULL || !is_user_vaddr (address))
+    return NULL;
+
+  p.addr = pg_round_down (address);
+  e = hash_find (t->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Returns true if page P's data may come from the share cache,
+   that is, if it is file data that no one has modified.  That
+   includes the read-only pages of every executable, so every
+   process running the same program uses the same copy of its
+   code. */
+static bool
+page_shareable (struct page *p)
+{
+  return (p->file != NULL && p->sector == (block_sector_t) -1
+          && (!p->private || p->read_only));
+}
+
+/* Obtains a frame for page P and fills it with P's contents.
+   WRITE is true if P is being faulted in to be written.
+   Returns true if successful, false on failure, in either case
+   with P's frame (if any) locked. */
+static bool
+do_page_in (struct page *p, bool write)
+{
+  bool fresh = true;
+
+  /* Get a frame for the page.  A page that is only being read
+     can share a frame with other processes that map the same
+     file data. */
+  if (!write && page_shareable (p))
+    p->frame = frame_share_and_lock (p, &fresh);
+  else
+    p->frame = frame_alloc_and_lock (p);
+  if (p->frame == NULL)
+    return false;
+  if (!fresh)
+    return true;
+
+  /* Copy data into the frame. */
+  if (p->sector != (block_sector_t) -1)
+    {
+      swap_in (p);
+      thread_current ()->pages_read++;
+    }
+  else if (p->file != NULL)
+    {
+      off_t read_bytes, zero_bytes;
+
+      thread_current ()->pages_read++;
+      read_bytes = file_read_at (p->file, p->frame->base,
+                                 p->file_bytes, p->file_offset);
+      zero_bytes = PGSIZE - read_bytes;
+
+      /* A short read means the file shrank under us; the rest of
+         the page reads as zeros, as it would past end of file. */
+      memset ((uint8_t *) p->frame->base + read_bytes, 0, zero_bytes);
+    }
+  else
+    memset (p->frame->base, 0, PGSIZE);
+
+  return true;
+}
+
+/* Returns true if ADDR, which is not in any page of the current
+   process, looks like an access to the process's stack just
+   beyond its end: within stack_max bytes of the top of user
+   memory and no more than 32 bytes below the stack pointer,
+   which is as far as PUSHA reaches before it adjusts %esp. */
+static bool
+is_stack_access (const void *addr)
+{
+  const uint8_t *esp = thread_current ()->user_esp;
+
+  return ((uint8_t *) addr < (uint8_t *) PHYS_BASE
+          && (uint8_t *) addr >= (uint8_t *) PHYS_BASE - stack_max
+          && (uint8_t *) addr + 32 >= esp);
+}
+
+/* Returns true if the current process may access user address
+   ADDR, writing to it if WRITE: that is, if the kernel can touch
+   ADDR on the process's behalf and count on the page fault
+   handler to bring it in, grow the stack to it, or unshare it. */
+bool
+page_accessible (const void *addr, bool write)
+{
+  struct page *p = page_for_addr (addr);
+
+  if (p == NULL)
+    return is_user_vaddr (addr) && is_stack_access (addr);
+  return !write || !p->read_only;
+}
+
+/* Returns true if page Q, which may be null, is the page N pages
+   past page P in the same run of file data, and has not been
+   faulted in. */
+static bool
+follows_in_file (struct page *p, struct page *q, size_t n)
+{
+  return (q != NULL && q->file == p->file
+          && q->file_offset == p->file_offset + (off_t) (n * PGSIZE)
+          && q->private == p->private && q->read_only == p->read_only
+          && q->frame == NULL && q->sector == (block_sector_t) -1
+          && pagedir_get_page (q->thread->pagedir, q->addr) == NULL);
+}
+
+/* Having just read page P in from its file, also reads in and
+   maps some of the pages that follow it in the file, so that a
+   process walking through a file or its executable takes one
+   fault per window of pages instead of one per page.
+
+   The window adapts to the access pattern.  It doubles, up to
+   FAULT_AROUND_MAX pages, each time a fault lands just past the
+   pages mapped by the previous one, and halves on any other
+   fault, so that random access soon stops reading ahead.
+   Reading ahead never evicts anything: it stops as soon as no
+   frame is free. */
+static void
+fault_around (struct page *p)
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  if (p->addr == t->fault_next)
+    t->fault_window = (t->fault_window == 0 ? 1
+                       : t->fault_window * 2 < FAULT_AROUND_MAX
+                       ? t->fault_window * 2 : FAULT_AROUND_MAX);
+  else
+    t->fault_window /= 2;
+
+  for (i = 1; i <= t->fault_window; i++)
+    {
+      struct page *q = page_for_addr ((uint8_t *) p->addr + i * PGSIZE);
+      bool mapped;
+
+      if (!follows_in_file (p, q, i)
+          || !frame_available ()
+          || !do_page_in (q, false))
+        break;
+      mapped = pagedir_set_page (t->pagedir, q->addr, q->frame->base,
+                                 page_writable (q));
+      frame_unlock (q->frame);
+      if (!mapped)
+        break;
+    }
+  t->fault_next = (uint8_t *) p->addr + i * PGSIZE;
+}
+
+/* Faults in the page containing FAULT_ADDR.  WRITE is true if the
+   faulting access was a write.
+   An access just beyond the end of the stack grows the stack by
+   a page.  A page read from a file may bring some of the pages
+   after it along (see fault_around()).
+   Returns true if successful, false if FAULT_ADDR is not part
+   of the current process's address space, if WRITE is true but
+   the page is read-only, or if memory is exhausted. */
+bool
+page_in (void *fault_addr, bool write)
+{
+  struct page *p = page_for_addr (fault_addr);
+  bool from_swap = false;
+  bool from_file = false;
+  bool success;
+
+  if (p == NULL && is_stack_access (fault_addr))
+    p = page_allocate (fault_addr, false);
+  if (p == NULL || (write && p->read_only))
+    return false;
+
+  /* Until a zero-fill page is written, there is no need to give
+     it a frame: the zero page will do. */
+  if (!write && p->file == NULL && p->sector == (block_sector_t) -1
+      && p->frame == NULL)
+    return pagedir_set_page (p->thread->pagedir, p->addr, zero_page, false);
+
+  frame_lock (p);
+  if (p->frame == NULL)
+    {
+      from_swap = p->sector != (block_sector_t) -1;
+      from_file = !from_swap && p->file != NULL;
+      if (!do_page_in (p, write))
+        return false;
+    }
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  /* Install frame into page table.  Reading a page in from swap
+     frees its swap slot, so mark it dirty to make sure it is
+     written out again if it is evicted. */
+  success = pagedir_set_page (p->thread->pagedir, p->addr,
+                              p->frame->base, page_writable (p));
+  if (success && from_swap)
+    pagedir_set_dirty (p->thread->pagedir, p->addr, true);
+
+  /* Release frame. */
+  frame_unlock (p->frame);
+
+  if (success && from_file)
+    fault_around (p);
+  return success;
+}
+
+/* Handles a write to the page containing FAULT_ADDR, which is
+   writable but mapped read-only because its frame is shared or
+   because it maps the zero page.
+   Gives the page a frame of its own: takes over the frame if no
+   other page uses it, otherwise copies it.
+   Returns true if successful, false if FAULT_ADDR is not in a
+   writable page or if memory is exhausted. */
+bool
+page_unshare (void *fault_addr)
+{
+  struct page *p = page_for_addr (fault_addr);
+  struct frame *f;
+  bool success;
+
+  if (p == NULL || p->read_only)
+    return false;
+
+  frame_lock (p);
+  f = p->frame;
+  if (f == NULL)
+    {
+      /* Either the page maps the zero page, and now needs a frame
+         of its own, or it was evicted since the fault, and
+         retrying the access will fault it back in. */
+      if (pagedir_get_page (p->thread->pagedir, p->addr) != zero_page)
+        return true;
+      pagedir_clear_page (p->thread->pagedir, p->addr);
+      return page_in (fault_addr, true);
+    }
+
+  pagedir_clear_page (p->thread->pagedir, p->addr);
+  if (list_begin (&f->pages) == list_rbegin (&f->pages))
+    frame_unshare (f);
+  else
+    {
+      struct frame *copy;
+
+      leave_frame (p);
+      copy = frame_alloc_and_lock (p);
+      if (copy == NULL)
+        {
+          list_push_back (&f->pages, &p->frame_elem);
+          p->frame = f;
+          pagedir_set_page (p->thread->pagedir, p->addr, f->base, false);
+          frame_unlock (f);
+          return false;
+        }
+      memcpy (copy->base, f->base, PGSIZE);
+      frame_unlock (f);
+      p->frame = f = copy;
+    }
+
+  success = pagedir_set_page (p->thread->pagedir, p->addr, f->base, true);
+  frame_unlock (f);
+  return success;
+}
+
+/* Handles a page fault at FAULT_ADDR in the current process.
+   NOT_PRESENT and WRITE describe the fault as for page_fault() in
+   userprog/exception.c.  Returns true if the fault was resolved
+   and the access should be retried, false if it was a genuine
+   access violation.
+   Counts the fault in the process's statistics: it is "major" if
+   it had to read a page from a file or from swap (including pages
+   read ahead), otherwise "minor". */
+bool
+page_handle_fault (void *fault_addr, bool not_present, bool write)
+{
+  struct thread *t = thread_current ();
+  uint64_t start = tsc_read ();
+  unsigned long pages_read = t->pages_read;
+  bool success;
+
+  /* Pages are loaded on first access, so a fault on a page that
+     the process has but that isn't present yet is routine.  So is
+     a write to a writable page that is mapped read-only because
+     it is shared. */
+  if (not_present)
+    success = page_in (fault_addr, write);
+  else
+    success = write && page_unshare (fault_addr);
+
+  if (success)
+    {
+      if (t->pages_read != pages_read)
+        t->major_faults++;
+      else
+        t->minor_faults++;
+      t->fault_cycles += tsc_read () - start;
+    }
+  return success;
+}
+
+/* Fills in *S with the current process's paging statistics and
+   the state of the frame table.  The counts of pages by residency
+   are a snapshot that pages being evicted may make stale. */
+void
+page_get_stats (struct vmstat *s)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+
+  memset (s, 0, sizeof *s);
+  s->minor_faults = t->minor_faults;
+  s->major_faults = t->major_faults;
+  s->pages_read = t->pages_read;
+  s->fault_cycles = t->fault_cycles;
+
+  hash_first (&i, t->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+
+      if (pagedir_get_page (t->pagedir, p->addr) != NULL)
+        s->resident_pages++;
+      else if (p->sector != (block_sector_t) -1)
+        s->swapped_pages++;
+      if (p->file != NULL)
+        s->file_pages++;
+      else
+        s->anon_pages++;
+    }
+
+  frame_get_stats (s);
+}
+
+/* Prints paging statistics for processes that have exited,
+   and for the frame table. */
+void
+page_print_stats (void)
+{
+  printf ("Paging: %llu minor faults, %llu major faults, "
+          "%llu pages read\n", minor_total, major_total, read_total);
+  frame_print_stats ();
+}
+
+/* Returns true if any page in frame F has been accessed
+   recently, false otherwise.  Clears the pages' accessed bits,
+   so the frame counts as recently accessed again only if it is
+   used again.
+   F must be locked. */
+bool
+page_accessed_recently (struct frame *f)
+{
+  struct list_elem *e;
+  bool was_accessed = false;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (pagedir_is_accessed (p->thread->pagedir, p->addr))
+        {
+          pagedir_set_accessed (p->thread->pagedir, p->addr, false);
+          was_accessed = true;
+        }
+    }
+  return was_accessed;
+}
+
+/* Returns true if any page in frame F has been modified since
+   it was read in or zeroed.  F must be locked. */
+static bool
+frame_dirty (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (pagedir_is_dirty (p->thread->pagedir, p->addr))
+        return true;
+    }
+  return false;
+}
+
+/* Returns true if frame F must be written to swap to be evicted,
+   that is, if its pages are private and have been modified since
+   they were read from their file, zeroed, or read back from
+   swap.  F must be locked and hold at least one page. */
+bool
+page_needs_swap (struct frame *f)
+{
+  struct page *p;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (!list_empty (&f->pages));
+
+  p = list_entry (list_front (&f->pages), struct page, frame_elem);
+  return p->private && frame_dirty (f);
+}
+
+/* Returns true if frame F can be evicted: either its data can be
+   recovered later without writing it out, or it goes back to its
+   file, or there is swap to write it to.
+   F must be locked and hold at least one page. */
+bool
+page_evictable (struct frame *f)
+{
+  return !page_needs_swap (f) || swap_available ();
+}
+
+/* Marks every page in frame F not present in its page table,
+   forcing accesses to fault.  This must happen before checking
+   dirty bits, to prevent a race with a process dirtying a page
+   as it is evicted. */
+static void
+unmap_frame (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      pagedir_clear_page (p->thread->pagedir, p->addr);
+    }
+}
+
+/* Maps every page in frame F back in, after an attempt to evict
+   it failed.  Preserves dirty bits. */
+static void
+remap_frame (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      bool dirty = pagedir_is_dirty (p->thread->pagedir, p->addr);
+      pagedir_set_page (p->thread->pagedir, p->addr, f->base,
+                        page_writable (p));
+      pagedir_set_dirty (p->thread->pagedir, p->addr, dirty);
+    }
+}
+
+/* Takes every page out of frame F, which must be locked.  The
+   pages' owners may free them at any time after that, so the
+   caller must not touch them again. */
+static void
+detach_frame (struct frame *f)
+{
+  while (!list_empty (&f->pages))
+    {
+      struct list_elem *e = list_pop_front (&f->pages);
+      list_entry (e, struct page, frame_elem)->frame = NULL;
+    }
+}
+
+/* Evicts the pages in frame F, writing their data to swap or
+   back to their file if necessary.  F must be locked and hold at
+   least one page.
+   Returns true if successful, false if the data couldn't be
+   written out.  On success, F holds no pages but remains
+   locked. */
+bool
+page_out (struct frame *f)
+{
+  bool ok = true;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (!list_empty (&f->pages));
+
+  unmap_frame (f);
+  if (frame_dirty (f))
+    {
+      struct page *p = list_entry (list_front (&f->pages),
+                                   struct page, frame_elem);
+      ok = p->private ? swap_out (f) : write_back (p);
+    }
+  if (!ok)
+    {
+      remap_frame (f);
+      return false;
+    }
+
+  detach_frame (f);
+  return true;
+}
+
+/* Evicts the pages in the CNT frames in FRAMES, each of which
+   must be locked and need swap (see page_needs_swap()), by
+   writing them all to swap in a single request.  Returns true
+   if successful, false if swap has no room for them together,
+   in which case none of them is evicted.  CNT must be at most
+   SWAP_CLUSTER.
+   On success, as for page_out(), the frames hold no pages but
+   remain locked. */
+bool
+page_out_cluster (struct frame *frames[], size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      ASSERT (lock_held_by_current_thread (&frames[i]->lock));
+      unmap_frame (frames[i]);
+    }
+
+  if (!swap_out_cluster (frames, cnt))
+    {
+      for (i = 0; i < cnt; i++)
+        remap_frame (frames[i]);
+      return false;
+    }
+
+  for (i = 0; i < cnt; i++)
+    detach_frame (frames[i]);
+  return true;
+}
+
+/* Adds page CHILD, which must not be resident, to the locked
+   frame of page PARENT, and maps every page in the frame
+   read-only, so that whichever process writes the frame first
+   gets its own copy (see page_unshare()).
+   Returns true if successful, false if memory is exhausted. */
+static bool
+share_frame (struct page *parent, struct page *child)
+{
+  struct frame *f = parent->frame;
+
+  if (!pagedir_set_page (child->thread->pagedir, child->addr,
+                         f->base, false))
+    return false;
+  list_push_back (&f->pages, &child->frame_elem);
+  child->frame = f;
+
+  unmap_frame (f);
+  remap_frame (f);
+  return true;
+}
+
+/* Copies the supplemental page table of process PARENT, which
+   must be blocked until we finish, into the current process,
+   whose table must be empty and whose exec_file must already be
+   open.  No data is copied: resident pages share PARENT's frames
+   and swapped-out pages share its swap slots.  Pages of
+   memory-mapped files are not inherited.
+   Returns true if successful, false if memory is exhausted. */
+bool
+page_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+
+  hash_first (&i, parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *cp;
+      bool ok = true;
+
+      if (!pp->private)
+        continue;
+
+      cp = page_allocate (pp->addr, pp->read_only);
+      if (cp == NULL)
+        return false;
+      cp->file = pp->file != NULL ? t->exec_file : NULL;
+      cp->file_offset = pp->file_offset;
+      cp->file_bytes = pp->file_bytes;
+
+      frame_lock (pp);
+      if (pp->frame != NULL)
+        {
+          ok = share_frame (pp, cp);
+          frame_unlock (pp->frame);
+        }
+      else if (pp->sector != (block_sector_t) -1)
+        {
+          swap_share (pp);
+          cp->sector = pp->sector;
+        }
+      if (!ok)
+        return false;
+    }
+  return true;
+}
+
+/* Adds a page at virtual address VADDR to the current process's
+   supplemental page table.  The page is initially all zeros and
+   has no frame; the caller may fill in its file members to make
+   it load from a file instead.
+   Returns the new page, or a null pointer if VADDR is already
+   in the table or if memory allocation fails. */
+struct page *
+page_allocate (void *vaddr, bool read_only)
+{
+  struct thread *t = thread_current ();
+  struct page *p = malloc (sizeof *p);
+
+  if (p != NULL)
+    {
+      p->addr = pg_round_down (vaddr);
+      p->read_only = read_only;
+      p->thread = t;
+      p->frame = NULL;
+      p->sector = (block_sector_t) -1;
+      p->private = true;
+      p->file = NULL;
+      p->file_offset = 0;
+      p->file_bytes = 0;
+
+      if (hash_insert (t->pages, &p->hash_elem) != NULL)
+        {
+          /* Already mapped. */
+          free (p);
+          p = NULL;
+        }
+    }
+  return p;
+}
+
+/* Removes the page at VADDR from the current process's
+   supplemental page table and destroys it, writing it back to
+   its file first if it is a modified page of a memory-mapped
+   file. */
+void
+page_deallocate (void *vaddr)
+{
+  struct page *p = page_for_addr (vaddr);
+
+  ASSERT (p != NULL);
+  hash_delete (thread_current ()->pages, &p->hash_elem);
+  destroy_page (&p->hash_elem, NULL);
+}
+
+/* Returns a hash value for the page that E refers to. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return ((uintptr_t) p->addr) >> PGBITS;
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+
+  return a->addr < b->addr;
+}
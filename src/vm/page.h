@@ -0,0 +1,76 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+struct frame;
+struct thread;
+
+/* A virtual page in a user process's address space.
+
+   Each process has a "supplemental page table" of these, the
+   hash table `pages' in its struct thread.  It records what
+   belongs in each page of the address space and where to get
+   its contents, so that pages need not be loaded until the
+   process first touches them.
+
+   A page that is not resident is read back from swap if it has
+   a swap slot, otherwise from its file, otherwise zeroed. */
+struct page
+  {
+    /* Immutable members. */
+    void *addr;                 /* User virtual address. */
+    bool read_only;             /* Read-only page? */
+    struct thread *thread;      /* Owning thread. */
+
+    /* Accessed only in owning process context. */
+    struct hash_elem hash_elem; /* struct thread `pages' hash element. */
+
+    /* Set only in owning process context with frame->lock held.
+       Cleared only with frame->lock held. */
+    struct frame *frame;        /* Page frame, or null if not resident. */
+    struct list_elem frame_elem; /* Element in frame's `pages' list. */
+
+    /* Swap information, protected by frame->lock. */
+    block_sector_t sector;      /* Starting sector of swap area, or -1. */
+
+    /* Backing file information, protected by frame->lock.  If
+       FILE is null, the page is initially all zeros. */
+    bool private;               /* False to write back to file,
+                                   true to write back to swap. */
+    struct file *file;          /* File. */
+    off_t file_offset;          /* Offset in file. */
+    off_t file_bytes;           /* Bytes to read/write, 1...PGSIZE. */
+  };
+
+/* Maximum size of a process's stack, in bytes.
+   Controlled by kernel command-line option "-stack=MB". */
+extern size_t stack_max;
+
+void page_init (void);
+bool page_table_init (void);
+bool page_fork (struct thread *parent);
+void page_exit (void);
+
+struct page *page_allocate (void *vaddr, bool read_only);
+void page_deallocate (void *vaddr);
+bool page_handle_fault (void *fault_addr, bool not_present, bool write);
+bool page_in (void *fault_addr, bool write);
+bool page_unshare (void *fault_addr);
+bool page_accessible (const void *addr, bool write);
+
+bool page_accessed_recently (struct frame *);
+bool page_needs_swap (struct frame *);
+bool page_evictable (struct frame *);
+bool page_out (struct frame *);
+bool page_out_cluster (struct frame *frames[], size_t cnt);
+
+struct vmstat;
+void page_get_stats (struct vmstat *);
+void page_print_stats (void);
+
+#endif /* vm/page.h */
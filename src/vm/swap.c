@@ -0,0 +1,263 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The swap device. */
+static struct block *swap_device;
+
+/* Used swap slots, one page each. */
+static struct bitmap *swap_bitmap;
+
+/* Number of pages whose contents are in each used slot.  A slot
+   is shared when a frame shared by several pages is swapped out,
+   or when a process forks while its pages are in swap. */
+static uint16_t *slot_refs;
+
+/* Protects swap_bitmap, slot_refs, and swap_hint. */
+static struct lock swap_lock;
+
+/* Slot at which to start looking for free slots.  Allocating
+   slots in order keeps pages that were evicted together next to
+   each other on disk. */
+static size_t swap_hint;
+
+/* Number of sectors per page. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Buffer into which a cluster of pages is gathered so that it
+   can be written to swap in a single request, and its lock.
+   The buffer is given back to the kernel pool under memory
+   pressure and allocated again when next needed. */
+static void *cluster_buffer;
+static struct lock cluster_lock;
+
+static size_t shrink_cluster_buffer (enum palloc_flags, size_t page_cnt);
+static struct shrinker cluster_shrinker =
+  {
+    .name = "swap cluster buffer",
+    .shrink = shrink_cluster_buffer,
+  };
+
+/* Sets up swap. */
+void
+swap_init (void)
+{
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    {
+      printf ("no swap device--swap disabled\n");
+      swap_bitmap = bitmap_create (0);
+    }
+  else
+    swap_bitmap = bitmap_create (block_size (swap_device) / PAGE_SECTORS);
+  if (swap_bitmap == NULL)
+    PANIC ("couldn't create swap bitmap");
+  /* Allocate one extra, because malloc(0) fails. */
+  slot_refs = calloc (bitmap_size (swap_bitmap) + 1, sizeof *slot_refs);
+  if (slot_refs == NULL)
+    PANIC ("couldn't create swap reference counts");
+  lock_init (&swap_lock);
+
+  /* Without a cluster buffer, we still work, one page at a
+     time. */
+  cluster_buffer = palloc_get_multiple (0, SWAP_CLUSTER);
+  lock_init (&cluster_lock);
+  palloc_register_shrinker (&cluster_shrinker);
+}
+
+/* Tries to allocate the cluster buffer if it has been freed.
+   Must not be called with cluster_lock held, because allocating
+   memory may call shrink_cluster_buffer(). */
+static void
+get_cluster_buffer (void)
+{
+  void *buffer = palloc_get_multiple (0, SWAP_CLUSTER);
+
+  lock_acquire (&cluster_lock);
+  if (cluster_buffer == NULL)
+    {
+      cluster_buffer = buffer;
+      buffer = NULL;
+    }
+  lock_release (&cluster_lock);
+  palloc_free_multiple (buffer, SWAP_CLUSTER);
+}
+
+/* Shrinker: frees the cluster buffer, unless it is in use.  Swap
+   writes a page at a time until it gets the buffer back. */
+static size_t
+shrink_cluster_buffer (enum palloc_flags flags, size_t page_cnt UNUSED)
+{
+  size_t freed = 0;
+
+  if ((flags & PAL_USER) || lock_held_by_current_thread (&cluster_lock)
+      || !lock_try_acquire (&cluster_lock))
+    return 0;
+  if (cluster_buffer != NULL)
+    {
+      palloc_free_multiple (cluster_buffer, SWAP_CLUSTER);
+      cluster_buffer = NULL;
+      freed = SWAP_CLUSTER;
+    }
+  lock_release (&cluster_lock);
+  return freed;
+}
+
+/* Returns true if there is a swap device, false otherwise. */
+bool
+swap_available (void)
+{
+  return swap_device != NULL;
+}
+
+/* Swaps in page P, which must have a locked frame (and be
+   swapped out), and frees its swap slot. */
+void
+swap_in (struct page *p)
+{
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+  ASSERT (p->sector != (block_sector_t) -1);
+
+  block_read_multiple (swap_device, p->sector, p->frame->base,
+                       PAGE_SECTORS);
+  swap_free (p);
+}
+
+/* Allocates CNT consecutive swap slots.  Returns the first, or
+   BITMAP_ERROR if there is no such run of free slots. */
+static size_t
+alloc_slots (size_t cnt)
+{
+  size_t slot;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_bitmap, swap_hint, cnt, false);
+  if (slot == BITMAP_ERROR && swap_hint != 0)
+    slot = bitmap_scan_and_flip (swap_bitmap, 0, cnt, false);
+  if (slot != BITMAP_ERROR)
+    swap_hint = slot + cnt;
+  lock_release (&swap_lock);
+
+  return slot;
+}
+
+/* Swaps out the pages in frame F, which must be locked.
+   Returns true if successful, false if swap is full. */
+bool
+swap_out (struct frame *f)
+{
+  return swap_out_cluster (&f, 1);
+}
+
+/* Swaps out the pages in the CNT frames in FRAMES, each of which
+   must be locked, to consecutive swap slots in a single write.
+   CNT must be at most SWAP_CLUSTER.
+   Returns true if successful, false if there is no run of CNT
+   free swap slots, in which case nothing is written. */
+bool
+swap_out_cluster (struct frame *frames[], size_t cnt)
+{
+  block_sector_t sector;
+  size_t slot, i;
+
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+  for (i = 0; i < cnt; i++)
+    {
+      ASSERT (lock_held_by_current_thread (&frames[i]->lock));
+      ASSERT (!list_empty (&frames[i]->pages));
+    }
+
+  if (cnt > 1)
+    {
+      if (cluster_buffer == NULL)
+        get_cluster_buffer ();
+      lock_acquire (&cluster_lock);
+      if (cluster_buffer == NULL)
+        {
+          lock_release (&cluster_lock);
+          return false;
+        }
+    }
+  slot = alloc_slots (cnt);
+  if (slot == BITMAP_ERROR)
+    {
+      if (cnt > 1)
+        lock_release (&cluster_lock);
+      return false;
+    }
+  sector = slot * PAGE_SECTORS;
+
+  if (cnt == 1)
+    block_write_multiple (swap_device, sector, frames[0]->base,
+                          PAGE_SECTORS);
+  else
+    {
+      for (i = 0; i < cnt; i++)
+        memcpy ((uint8_t *) cluster_buffer + i * PGSIZE,
+                frames[i]->base, PGSIZE);
+      block_write_multiple (swap_device, sector, cluster_buffer,
+                            cnt * PAGE_SECTORS);
+      lock_release (&cluster_lock);
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct list_elem *e;
+
+      lock_acquire (&swap_lock);
+      slot_refs[slot + i] = list_size (&frames[i]->pages);
+      lock_release (&swap_lock);
+      for (e = list_begin (&frames[i]->pages);
+           e != list_end (&frames[i]->pages); e = list_next (e))
+        {
+          struct page *p = list_entry (e, struct page, frame_elem);
+          p->sector = sector + i * PAGE_SECTORS;
+        }
+    }
+  return true;
+}
+
+/* Makes page P's swap slot, which P must be swapped out to, hold
+   the contents of one more page as well, which the caller then
+   points at the same slot. */
+void
+swap_share (struct page *p)
+{
+  size_t slot = p->sector / PAGE_SECTORS;
+
+  ASSERT (p->sector != (block_sector_t) -1);
+
+  lock_acquire (&swap_lock);
+  ASSERT (slot_refs[slot] > 0 && slot_refs[slot] < UINT16_MAX);
+  slot_refs[slot]++;
+  lock_release (&swap_lock);
+}
+
+/* Releases page P's swap slot, freeing it if no other page
+   shares it.  P must be swapped out, or being swapped in with
+   its frame locked. */
+void
+swap_free (struct page *p)
+{
+  size_t slot = p->sector / PAGE_SECTORS;
+
+  ASSERT (p->sector != (block_sector_t) -1);
+
+  lock_acquire (&swap_lock);
+  ASSERT (slot_refs[slot] > 0);
+  if (--slot_refs[slot] == 0)
+    bitmap_reset (swap_bitmap, slot);
+  lock_release (&swap_lock);
+  p->sector = (block_sector_t) -1;
+}
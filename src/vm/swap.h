@@ -0,0 +1,21 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct frame;
+struct page;
+
+/* Maximum number of pages written to swap in a single request. */
+#define SWAP_CLUSTER 8
+
+void swap_init (void);
+bool swap_available (void);
+void swap_in (struct page *);
+bool swap_out (struct frame *);
+bool swap_out_cluster (struct frame *frames[], size_t cnt);
+void swap_share (struct page *);
+void swap_free (struct page *);
+
+#endif /* vm/swap.h */